@@ -44,6 +44,17 @@ struct BBox {
         max = maxPoint(max, p);
     }
 
+    // Returns the position of point _p_ relative to the box corners, where the min corner
+    // maps to (0, 0, 0) and the max corner to (1, 1, 1)
+    CRTVectorf offset(const CRTVectorf& p) const {
+        CRTVectorf o = p - min;
+        for (int i = 0; i < 3; i++) {
+            if (max[i] > min[i])
+                o[i] /= max[i] - min[i];
+        }
+        return o;
+    }
+
     //Verifies if ray intersects with the box using Kay and Kajiyas 
     // slab method
     // source https://github.com/mmp/pbrt-v3/blob/master/src/core/geometry.h
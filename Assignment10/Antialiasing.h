@@ -0,0 +1,65 @@
+#ifndef ANTIALIASING_H
+#define ANTIALIASING_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+#include "PPMImage.h"
+
+/// @brief Finds the pixels that adaptive antialiasing refines. The first pass traces one ray
+/// through each pixel center and records the object its camera ray hit. A pixel is on an edge when
+/// its color differs from one of its 8 neighbours by more than a threshold, or when its camera ray
+/// hit a different object, and so a different material, than the one of a neighbour.
+class AntialiasMap {
+public:
+    AntialiasMap() = delete;
+
+    AntialiasMap(const int _width, const int _height)
+        : width(_width), height(_height), hitIds(size_t(_width) * _height, 0) {}
+
+    // Records the object the camera ray of _pixel_ hit, -1 if it missed. Each pixel is written by
+    // the one thread that renders it
+    void setPrimaryHit(const size_t pixel, const int32_t objectIdx) { hitIds[pixel] = objectIdx + 1; }
+
+    // Finds the edge pixels of the first pass image. _threshold_ is the largest color difference
+    // of a color component from a neighbour, as a fraction of MAX_COLOR_COMP, that isn't an edge
+    void findEdgePixels(const PPMImageI& ppmImage, const float threshold) {
+        const int maxDiff = int(threshold * MAX_COLOR_COMP);
+        edgePixels.clear();
+        for (int row = 0; row < height; row++) {
+            for (int col = 0; col < width; col++) {
+                if (isEdgePixel(ppmImage, row, col, maxDiff)) {
+                    edgePixels.push_back(uint32_t(size_t(row) * width + col));
+                }
+            }
+        }
+    }
+
+    // Returns the edge pixels found by the last findEdgePixels, in image order
+    const std::vector<uint32_t>& getEdgePixels() const { return edgePixels; }
+
+private:
+    bool isEdgePixel(const PPMImageI& ppmImage, const int row, const int col, const int maxDiff) const {
+        const size_t pixel = size_t(row) * width + col;
+        const PPMPixelI& color = ppmImage.data[pixel];
+        for (int r = std::max(row - 1, 0); r <= std::min(row + 1, height - 1); r++) {
+            for (int c = std::max(col - 1, 0); c <= std::min(col + 1, width - 1); c++) {
+                const size_t neighbour = size_t(r) * width + c;
+                const PPMPixelI& neighbourColor = ppmImage.data[neighbour];
+                if (hitIds[neighbour] != hitIds[pixel] || std::abs(neighbourColor.r - color.r) > maxDiff ||
+                    std::abs(neighbourColor.g - color.g) > maxDiff || std::abs(neighbourColor.b - color.b) > maxDiff) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    const int width;
+    const int height;
+    std::vector<int32_t> hitIds;  // Index + 1 of the object hit by the camera ray of each pixel, 0 for none
+    std::vector<uint32_t> edgePixels;
+};
+
+#endif
@@ -1,72 +1,1011 @@
+#include <sstream>
+#include "BatchPipeline.h"
+#include "CameraPath.h"
+#include "CpuDispatch.h"
+#include "MacroBenchmark.h"
+#include "PeakMemory.h"
 #include "Renderer.h"
+#include "UnixSocket.h"
+#include "WavefrontRenderer.h"
 
-static int32_t runRenderer(const std::string& inputFile, ThreadPool& pool,
-    const RenderSettings& settings) {
+// Runs _task_(threadId) for each of the _numThreads_ render threads on _pool_ and waits for them
+template <typename Task>
+static void runOnThreads(ThreadPool& pool, const unsigned numThreads, const Task& task) {
+    for (size_t threadId = 0; threadId < numThreads; threadId++) {
+        pool.scheduleTask(task, threadId);
+    }
+
+    // this thread only spins until the workers are done, which isn't rendering work
+    pauseThreadHwCounters();
+    pool.completeTasks();
+    resumeThreadHwCounters();
+}
+
+// Writes the image rendered by pass _pass_ of progressive rendering as <scene>.pass<pass>.ppm
+static int32_t writePreview(const std::string& inputFile, const int pass, const PPMImageI& ppmImage) {
+    CRT_TRACE_SCOPE("write preview", "write", "pass", pass);
+    const std::string previewFileName = getOutputFileName(inputFile, ".pass" + std::to_string(pass) + ".ppm");
+    std::ofstream previewFile(previewFileName, std::ios::out | std::ios::binary);
+    if (!previewFile.good()) {
+        std::cerr << "Failed to write " << previewFileName << " file." << std::endl;
+        return EXIT_FAILURE;
+    }
+    serializePPMImage(previewFile, ppmImage);
+    return EXIT_SUCCESS;
+}
+
+// Scene file on its way through parsing, building, rendering and writing
+struct SceneJob {
+    explicit SceneJob(std::string _inputFile) : inputFile(std::move(_inputFile)) {}
+
+    const std::string inputFile;
+    RenderStats stats;
+    std::shared_ptr<const Scene> scene;  // Released once the image is rendered
+    PPMImageI ppmImage{ 0, 0 };
+    std::unique_ptr<TileCostMap> tileCosts;
+    size_t memoryBytes = 0;  // Estimate of the memory held by the scene geometry and the image
+};
+
+// Parses the scene file of _job_ into _sceneParams_
+static int32_t parseScene(SceneJob& job, SceneParams& sceneParams, std::ostream& out) {
+    RenderStats& stats = job.stats;
+    stats.sceneFile = job.inputFile;
+    stats.hwCountersEnabled = isHwCountersEnabled();
+    {
+        CRT_TRACE_SCOPE("parse scene", "parse");
+        PhaseMeasure measure(stats, Phase::Parse);
+        if (parseSceneParams(job.inputFile, sceneParams) != EXIT_SUCCESS) {
+            std::cerr << "Failed to parse " << job.inputFile << " file." << std::endl;
+            return EXIT_FAILURE;
+        }
+        measure.stop();
+    }
+
+    const MeshDedupStats& dedupStats = sceneParams.dedupStats;
+    out << "Welded " << dedupStats.weldedVertices << " vertices, kept " << dedupStats.seamVertices
+        << " seam vertices split, dropped "
+        << dedupStats.degenerateTriangles << " degenerate triangles, shared geometry of "
+        << dedupStats.sharedMeshes << " objects. Saved " << dedupStats.savedBytes() / 1024.f
+        << "KB of " << dedupStats.bytesBefore / 1024.f << "KB mesh memory\n";
+
+    const SceneDimensions& dimens = sceneParams.settings.sceneDimensions;
+    job.memoryBytes = dedupStats.bytesAfter + size_t(dimens.width) * dimens.height * sizeof(PPMPixelI);
+    return EXIT_SUCCESS;
+}
+
+// Builds the scene of _job_ from _sceneParams_ and allocates its image
+static void buildScene(SceneJob& job, const SceneParams& sceneParams) {
+    PhaseMeasure buildMeasure(job.stats, Phase::Build);
+    job.scene = [&sceneParams] {
+        CRT_TRACE_SCOPE("build scene", "build");
+        return std::make_shared<const Scene>(sceneParams);
+    }();
+    buildMeasure.stop();
+
+    const SceneDimensions& dimens = job.scene->getSceneDimensions();
+    job.stats.width = dimens.width;
+    job.stats.height = dimens.height;
+    job.ppmImage = PPMImageI(dimens.width, dimens.height);
+}
+
+// Renders the image of _job_ on the threads of _pool_ and releases its scene
+static int32_t renderScene(SceneJob& job, ThreadPool& pool, const RenderSettings& settings, std::ostream& out) {
+    const std::string& inputFile = job.inputFile;
     const std::string ppmFileName = getPpmFileName(inputFile);
-    std::ofstream ppmImageFile(ppmFileName, std::ios::out | std::ios::binary);
-    if (!ppmImageFile.good()) {
-        std::cout << "Input file " << inputFile << " not good.\n";
+    RenderStats& stats = job.stats;
+    stats.numThreads = settings.numThreads;
+    const Scene& scene = *job.scene;
+    const SceneDimensions& dimens = scene.getSceneDimensions();
+    PPMImageI& ppmImage = job.ppmImage;
+
+    // initialize renderers
+    if (settings.recordTileCosts) {
+        job.tileCosts = std::make_unique<TileCostMap>(dimens.width, dimens.height, settings.numThreads);
+    }
+    TileCostMap* tileCosts = job.tileCosts.get();
+    std::unique_ptr<AntialiasMap> antialias;
+    if (settings.antialiasSamples > 1) {
+        antialias = std::make_unique<AntialiasMap>(dimens.width, dimens.height);
+    }
+    Renderer renderer(ppmImage, &scene, settings, tileCosts, antialias.get());
+    std::vector<WavefrontStageTimes> wavefrontStageTimes(settings.numThreads);
+    WavefrontRenderer wavefrontRenderer(ppmImage, &scene, settings, wavefrontStageTimes, tileCosts,
+        antialias.get());
+
+    out << "Loading " << ppmFileName << "...\nGenerating data...\n";
+    {
+        CRT_TRACE_SCOPE("render", "render");
+        PhaseMeasure measure(stats, Phase::Render);
+
+        std::unique_ptr<DeadlineController> deadline;
+        if (settings.timeBudgetMs > 0) {
+            deadline = std::make_unique<DeadlineController>(settings.timeBudgetMs * 1000000, settings.traceSettings,
+                settings.antialiasSamples, dimens.width, dimens.height, settings.numThreads);
+            runOnThreads(pool, settings.numThreads, [renderer, &deadline](const size_t threadId) mutable {
+                renderer.renderTiles(threadId, *deadline);
+            });
+        }
+        else if (settings.progressive) {
+            // writes a preview of the image after each pass but the last
+            const Timer renderTimer;
+            for (int pass = 0; pass < PROGRESSIVE_NUM_PASSES; pass++) {
+                runOnThreads(pool, settings.numThreads, [renderer, &settings, pass](const size_t threadId) mutable {
+                    renderer.renderPass(threadId, settings.numThreads, settings.numPixelsPerThread, pass);
+                });
+                out << "Pass " << pass << " done after [" << Timer::toMilliSec<float>(renderTimer.getElapsedNanoSec())
+                    << "ms]\n";
+                if (pass + 1 < PROGRESSIVE_NUM_PASSES && writePreview(inputFile, pass, ppmImage) != EXIT_SUCCESS) {
+                    return EXIT_FAILURE;
+                }
+            }
+        }
+        else if (settings.useWavefront) {
+            runOnThreads(pool, settings.numThreads, [wavefrontRenderer, &settings](const size_t threadId) mutable {
+                wavefrontRenderer.render(threadId, settings.numThreads, WAVEFRONT_BATCH_SIZE);
+            });
+        }
+        else {
+            runOnThreads(pool, settings.numThreads, [renderer, &settings](const size_t threadId) mutable {
+                renderer.render(threadId, settings.numThreads, settings.numPixelsPerThread);
+            });
+        }
+
+        if (antialias) {
+            // the edges need the colors of the neighbours, so they are found once all pixels are done
+            {
+                CRT_TRACE_SCOPE("find edges", "render");
+                antialias->findEdgePixels(ppmImage, settings.antialiasThreshold);
+            }
+            const size_t numEdgePixels = antialias->getEdgePixels().size();
+            // with a time budget, the samples are cut down to the ones that fit in the time left
+            const int samples = deadline ? deadline->planAntialias(numEdgePixels) : settings.antialiasSamples;
+            const TraceSettings& traceSettings = deadline ? deadline->getTraceSettings() : settings.traceSettings;
+            if (samples > 1) {
+                runOnThreads(pool, settings.numThreads,
+                    [renderer, &settings, samples, &traceSettings](const size_t threadId) mutable {
+                        renderer.refine(threadId, settings.numThreads, settings.numPixelsPerThread, samples,
+                            traceSettings);
+                    });
+                out << "Antialiased " << numEdgePixels << " edge pixels ("
+                    << 100.f * numEdgePixels / ppmImage.data.size() << "%) with " << samples * samples
+                    << " samples each\n";
+            }
+            else {
+                out << "Skipped antialiasing of " << numEdgePixels << " edge pixels to meet the time budget\n";
+            }
+        }
+        measure.stop();
+        if (deadline) {
+            stats.deadline = deadline->getReport();
+        }
+
+        out << ppmFileName << " generated in ["
+            << Timer::toMilliSec<float>(stats.phaseNanoSec[int(Phase::Render)]) << "ms] on "
+            << settings.numThreads << " threads\n";
+    }
+    // the pool threads are idle, so their counters can be merged
+    stats.counters = StatRegistry::get().collect();
+    job.scene.reset();
+
+    if (settings.useWavefront) {
+        WavefrontStageTimes stageTimes;
+        for (const WavefrontStageTimes& threadStageTimes : wavefrontStageTimes) {
+            stageTimes.add(threadStageTimes);
+        }
+        stageTimes.print(out);
+    }
+    return EXIT_SUCCESS;
+}
+
+// Writes the image of _job_, its tile costs if they were recorded and its statistics. The image
+// file is only created here, so a scene that fails earlier leaves no empty image behind. The peak
+// memory is the one of the process since it was last reset
+static int32_t writeScene(SceneJob& job, std::ostream& out) {
+    const std::string& inputFile = job.inputFile;
+    RenderStats& stats = job.stats;
+    {
+        CRT_TRACE_SCOPE("serialize image", "write");
+        PhaseMeasure measure(stats, Phase::Write);
+        std::ofstream ppmImageFile(getPpmFileName(inputFile), std::ios::out | std::ios::binary);
+        if (!ppmImageFile.good()) {
+            out << "Input file " << inputFile << " not good.\n";
+            return EXIT_FAILURE;
+        }
+        serializePPMImage(ppmImageFile, job.ppmImage);
+        ppmImageFile.close();
+        measure.stop();
+    }
+    stats.peakMemoryBytes = getPeakMemoryBytes();
+    stats.imageChecksum = getImageChecksum(job.ppmImage);
+
+    if (job.tileCosts) {
+        job.tileCosts->printBalance(out);
+        const std::string heatmapFileName = getOutputFileName(inputFile, ".heatmap.ppm");
+        const std::string tileCsvFileName = getOutputFileName(inputFile, ".tiles.csv");
+        std::ofstream heatmapFile(heatmapFileName, std::ios::out | std::ios::binary);
+        std::ofstream tileCsvFile(tileCsvFileName);
+        if (!heatmapFile.good() || !tileCsvFile.good()) {
+            std::cerr << "Failed to write " << heatmapFileName << " and " << tileCsvFileName << " files."
+                << std::endl;
+            return EXIT_FAILURE;
+        }
+        job.tileCosts->writeHeatmap(heatmapFile);
+        job.tileCosts->writeCsv(tileCsvFile);
+    }
+
+    stats.print(out);
+    const std::string statsFileName = getOutputFileName(inputFile, ".stats.json");
+    std::ofstream statsFile(statsFileName);
+    if (!statsFile.good()) {
+        std::cerr << "Failed to write " << statsFileName << " file." << std::endl;
         return EXIT_FAILURE;
     }
+    stats.writeJson(statsFile);
 
-    SceneParams sceneParams;
-    if (parseSceneParams(inputFile, sceneParams) != EXIT_SUCCESS) {
-        std::cerr << "Failed to parse " << inputFile << " file." << std::endl;
+    return EXIT_SUCCESS;
+}
+
+// Renders _inputFile_ and writes the image and the statistics of the render, which are also
+// returned in _stats_
+static int32_t runRenderer(const std::string& inputFile, ThreadPool& pool,
+    const RenderSettings& settings, RenderStats& stats) {
+    resetPeakMemory();
+    SceneJob job(inputFile);
+    {
+        SceneParams sceneParams;
+        if (parseScene(job, sceneParams, std::cout) != EXIT_SUCCESS) {
+            return EXIT_FAILURE;
+        }
+        buildScene(job, sceneParams);
+    }
+    if (renderScene(job, pool, settings, std::cout) != EXIT_SUCCESS || writeScene(job, std::cout) != EXIT_SUCCESS) {
         return EXIT_FAILURE;
     }
+    stats = job.stats;
+    return EXIT_SUCCESS;
+}
+
+// Renders _sceneFiles_ in a pipeline of three stages, so parsing and writing don't leave the pool
+// idle. A loader thread parses and builds the next scenes while the pool renders the current one,
+// and a writer thread writes the images and statistics of the rendered ones. _limit_ bounds the
+// scenes in flight. Each stage prints the output of a scene at once, so the outputs don't mix.
+// The batch stops at the first scene that fails, as rendering them one after another would: the
+// scenes before it are still rendered and written, even when the loader reached it first, and the
+// ones after it are skipped
+static int32_t runBatch(const std::vector<std::string>& sceneFiles, ThreadPool& pool,
+    const RenderSettings& settings, BatchLimit& limit) {
+    StageQueue<std::unique_ptr<SceneJob>> builtJobs, renderedJobs;
+    std::atomic<size_t> firstFailed = sceneFiles.size();  // Index of the first scene that failed
+    std::mutex printMutex;
+    const auto print = [&printMutex](const std::ostringstream& out) {
+        std::lock_guard<std::mutex> lock(printMutex);
+        std::cout << out.str() << std::flush;
+    };
+    const auto fail = [&firstFailed](const SceneJob& job, const size_t index) {
+        size_t failedIndex = firstFailed;
+        while (index < failedIndex && !firstFailed.compare_exchange_weak(failedIndex, index)) {}
+        std::cerr << "Failed to render file - " << job.inputFile << std::endl;
+    };
+
+    std::thread loader([&] {
+        TraceRecorder::get().setThreadName("scene loader");
+        for (size_t index = 0; index < sceneFiles.size() && index < firstFailed; index++) {
+            std::unique_ptr<SceneJob> job = std::make_unique<SceneJob>(sceneFiles[index]);
+            std::ostringstream out;
+            SceneParams sceneParams;
+            if (parseScene(*job, sceneParams, out) != EXIT_SUCCESS) {
+                print(out);
+                fail(*job, index);
+                break;
+            }
+            // the next scene is parsed while the limits are full, but built only once it fits
+            limit.acquire(job->memoryBytes);
+            buildScene(*job, sceneParams);
+            print(out);
+            builtJobs.push(std::move(job));
+        }
+        builtJobs.close();
+    });
+
+    // the jobs reach each stage in the order of the scene files, so each stage counts their index
+    std::thread writer([&] {
+        TraceRecorder::get().setThreadName("image writer");
+        std::unique_ptr<SceneJob> job;
+        for (size_t index = 0; renderedJobs.pop(job); index++) {
+            std::ostringstream out;
+            if (index < firstFailed && writeScene(*job, out) != EXIT_SUCCESS) {
+                fail(*job, index);
+            }
+            print(out);
+            limit.release(job->memoryBytes);
+        }
+    });
+
+    // the jobs after a failure are passed on without rendering, so the limit is released
+    std::unique_ptr<SceneJob> job;
+    for (size_t index = 0; builtJobs.pop(job); index++) {
+        std::ostringstream out;
+        if (index < firstFailed && renderScene(*job, pool, settings, out) != EXIT_SUCCESS) {
+            fail(*job, index);
+        }
+        print(out);
+        renderedJobs.push(std::move(job));
+    }
+    renderedJobs.close();
+
+    loader.join();
+    writer.join();
+    return firstFailed < sceneFiles.size() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
 
-    // initialize scene
-    const Scene scene(sceneParams);
+// Frame of an animation on its way through rendering and writing
+struct AnimationFrame {
+    AnimationFrame(const int _index, const CRTCamera& _camera, const SceneDimensions& dimens, const bool antialiased)
+        : index(_index), camera(_camera), ppmImage(dimens.width, dimens.height),
+        antialias(antialiased ? std::make_unique<AntialiasMap>(dimens.width, dimens.height) : nullptr) {}
 
-    // initialize image
-    const SceneDimensions dimens = scene.getSceneDimensions();
-    PPMImageI ppmImage(dimens.width, dimens.height);
+    const int index;
+    const CRTCamera camera;
+    PPMImageI ppmImage;
+    std::unique_ptr<AntialiasMap> antialias;  // nullptr when not antialiasing
+};
 
-    // initialize renderer
-    Renderer renderer(ppmImage, &scene);
+// Returns how many frames of _dimens_ pixels to render at once on _numThreads_ threads. A frame
+// gets at most one thread per ANIMATION_MIN_PIXELS_PER_THREAD pixels, as with less work the
+// threads of a frame mostly wait for each other at its end, and the threads left over render
+// other frames at the same time. The frames rendered at once are held until all of them are done,
+// so together they must fit in _memoryLimitBytes_, or the last ones would wait for the writer to
+// release memory that only the first ones can free
+static unsigned getFramesAtOnce(const SceneDimensions& dimens, const unsigned numThreads, const int numFrames,
+    const size_t frameBytes, const size_t memoryLimitBytes) {
+    const size_t maxFrameThreads =
+        std::max<size_t>(1, size_t(dimens.width) * dimens.height / ANIMATION_MIN_PIXELS_PER_THREAD);
+    const size_t maxFrames = std::min<size_t>(size_t(numFrames), memoryLimitBytes / frameBytes);
+    return unsigned(std::clamp<size_t>(numThreads / maxFrameThreads, 1, std::max<size_t>(maxFrames, 1)));
+}
+
+// Writes _frame_ of the animation of _inputFile_ as <scene>.frame<index>.ppm, the index padded with
+// zeros to the digits of the last frame, at least 4, so the files sort in frame order
+static int32_t writeFrame(const std::string& inputFile, const AnimationFrame& frame, const int numFrames) {
+    CRT_TRACE_SCOPE("write frame", "write", "frame", frame.index);
+    const size_t numDigits = std::max<size_t>(4, std::to_string(numFrames - 1).size());
+    std::string index = std::to_string(frame.index);
+    index.insert(0, numDigits - std::min(numDigits, index.size()), '0');
+    const std::string frameFileName = getOutputFileName(inputFile, ".frame" + index + ".ppm");
+    std::ofstream frameFile(frameFileName, std::ios::out | std::ios::binary);
+    serializePPMImage(frameFile, frame.ppmImage);
+    if (!frameFile.good()) {
+        std::cerr << "Failed to write " << frameFileName << " file." << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
 
-    std::cout << "Loading " << ppmFileName << "...\nGenerating data...\n";
+// Renders the frames of the camera path in _cameraPathFile_ through the scene _inputFile_, which
+// is parsed and built once for all of them. When a frame can't use all the pool threads, see
+// getFramesAtOnce, several frames render at once, each on its share of the threads. A writer
+// thread writes the rendered frames while the next ones render, and _memoryLimitBytes_ bounds the
+// frames waiting for it
+static int32_t runAnimation(const std::string& inputFile, const std::string& cameraPathFile, ThreadPool& pool,
+    const RenderSettings& settings, const size_t memoryLimitBytes) {
+    CameraPath cameraPath;
+    if (cameraPath.parse(cameraPathFile) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    SceneJob job(inputFile);
     {
-        Timer timer;
+        SceneParams sceneParams;
+        if (parseScene(job, sceneParams, std::cout) != EXIT_SUCCESS) {
+            return EXIT_FAILURE;
+        }
+        buildScene(job, sceneParams);
+    }
+    const Scene& scene = *job.scene;
+    const SceneDimensions& dimens = scene.getSceneDimensions();
+    const int numFrames = cameraPath.getNumFrames();
+    const size_t frameBytes = size_t(dimens.width) * dimens.height * sizeof(PPMPixelI);
+    const unsigned framesAtOnce =
+        getFramesAtOnce(dimens, settings.numThreads, numFrames, frameBytes, memoryLimitBytes);
+    const unsigned frameThreads = settings.numThreads / framesAtOnce;
+    const bool antialiased = settings.antialiasSamples > 1;
+    std::cout << "Rendering " << numFrames << " frames of " << inputFile << ", " << framesAtOnce << " at once on "
+        << frameThreads << " threads each\n";
 
-        for (size_t threadId = 0; threadId < settings.numThreads; threadId++) {
-            auto renderTask = std::bind(&Renderer::render, renderer, threadId, settings.numThreads,
-                settings.numPixelsPerThread);
-            pool.scheduleTask(renderTask);
+    BatchLimit limit(2 * size_t(framesAtOnce), memoryLimitBytes);
+    StageQueue<std::unique_ptr<AnimationFrame>> renderedFrames;
+    std::atomic<bool> failed = false;
+    std::thread writer([&] {
+        TraceRecorder::get().setThreadName("image writer");
+        std::unique_ptr<AnimationFrame> frame;
+        while (renderedFrames.pop(frame)) {
+            if (!failed && writeFrame(inputFile, *frame, numFrames) != EXIT_SUCCESS) {
+                failed = true;
+            }
+            limit.release(frameBytes);
         }
+    });
 
-        pool.completeTasks();
+    const Timer animationTimer;
+    for (int first = 0; first < numFrames && !failed; first += int(framesAtOnce)) {
+        CRT_TRACE_SCOPE("render frames", "render", "first_frame", first);
+        const int count = std::min(int(framesAtOnce), numFrames - first);
+        std::vector<std::unique_ptr<AnimationFrame>> frames;
+        std::vector<Renderer> renderers;
+        renderers.reserve(count);
+        for (int frame = first; frame < first + count; frame++) {
+            limit.acquire(frameBytes);
+            frames.push_back(std::make_unique<AnimationFrame>(frame, cameraPath.getCamera(scene.getCamera(), frame),
+                dimens, antialiased));
+            renderers.emplace_back(frames.back()->ppmImage, &scene, settings, nullptr, frames.back()->antialias.get(),
+                &frames.back()->camera);
+        }
 
-        std::cout << ppmFileName << " generated in ["
-            << Timer::toMilliSec<float>(timer.getElapsedNanoSec()) << "ms] on "
-            << settings.numThreads << " threads\n";
+        // pool thread t renders frame t / frameThreads
+        runOnThreads(pool, count * frameThreads, [&renderers, &settings, frameThreads](const size_t threadId) {
+            Renderer renderer = renderers[threadId / frameThreads];
+            renderer.render(threadId % frameThreads, frameThreads, settings.numPixelsPerThread);
+        });
+        if (antialiased) {
+            for (const std::unique_ptr<AnimationFrame>& frame : frames) {
+                frame->antialias->findEdgePixels(frame->ppmImage, settings.antialiasThreshold);
+            }
+            runOnThreads(pool, count * frameThreads, [&renderers, &settings, frameThreads](const size_t threadId) {
+                Renderer renderer = renderers[threadId / frameThreads];
+                renderer.refine(threadId % frameThreads, frameThreads, settings.numPixelsPerThread,
+                    settings.antialiasSamples, settings.traceSettings);
+            });
+        }
+
+        for (std::unique_ptr<AnimationFrame>& frame : frames) {
+            renderedFrames.push(std::move(frame));
+        }
     }
+    renderedFrames.close();
+    writer.join();
 
-    serializePPMImage(ppmImageFile, ppmImage);
-    ppmImageFile.close();
+    const int64_t animationNanoSec = animationTimer.getElapsedNanoSec();
+    const StatCounters counters = StatRegistry::get().collect();
+    std::cout << "Rendered " << numFrames << " frames in [" << Timer::toMilliSec<float>(animationNanoSec) << "ms], "
+        << Timer::toMilliSec<float>(animationNanoSec) / numFrames << "ms per frame, "
+        << counters.getNumRays() * 1e3 / animationNanoSec << " Mrays/s\n";
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// Scene the render daemon keeps loaded between requests and the view it renders it from
+struct DaemonState {
+    std::string sceneFile;
+    std::shared_ptr<Scene> scene;
+    CRTCamera sceneCamera;  // Camera of the scene file, restored by reset_camera
+    CRTCamera camera;
+    SceneDimensions dimens;
+};
 
+// Handles _request_ of a render daemon client and writes the response to _connection_. Returns
+// false when the connection is to be closed, and sets _shutdown_ when the daemon is to exit
+static bool handleDaemonRequest(const std::string& request, DaemonState& state, ThreadPool& pool,
+    const RenderSettings& settings, SocketConnection& connection, bool& shutdown) {
+    std::istringstream words(request);
+    std::string command;
+    words >> command;
+    const auto respond = [&connection](const std::string& response) { return connection.write(response + "\n"); };
+
+    if (command == "quit" || command == "shutdown") {
+        shutdown = command == "shutdown";
+        respond("ok");
+        return false;
+    }
+    if (command == "load") {
+        std::string file;
+        std::getline(words >> std::ws, file);
+        if (file.empty() || !std::ifstream(file).good()) {
+            return respond("error can't open " + file);
+        }
+        SceneJob job(file);
+        SceneParams sceneParams;
+        if (parseScene(job, sceneParams, std::cout) != EXIT_SUCCESS) {
+            return respond("error can't parse " + file);
+        }
+        PhaseMeasure buildMeasure(job.stats, Phase::Build);
+        state.scene = std::make_shared<Scene>(sceneParams);
+        buildMeasure.stop();
+        state.sceneFile = file;
+        state.sceneCamera = state.camera = state.scene->getCamera();
+        state.dimens = state.scene->getSceneDimensions();
+        std::cout << "Loaded " << file << " in ["
+            << Timer::toMilliSec<float>(job.stats.phaseNanoSec[int(Phase::Parse)]) << "ms] and built it in ["
+            << Timer::toMilliSec<float>(job.stats.phaseNanoSec[int(Phase::Build)]) << "ms]\n";
+        return respond("ok " + std::to_string(state.dimens.width) + " " + std::to_string(state.dimens.height));
+    }
+    if (!state.scene) {
+        return respond("error no scene loaded");
+    }
+
+    if (command == "truck" || command == "boom" || command == "dolly" || command == "pan" || command == "tilt" ||
+        command == "roll") {
+        float value = 0.f;
+        if (!(words >> value)) {
+            return respond("error " + command + " takes a number");
+        }
+        CRTCamera& camera = state.camera;
+        if (command == "truck") {
+            camera.truck(value);
+        }
+        else if (command == "boom") {
+            camera.boom(value);
+        }
+        else if (command == "dolly") {
+            camera.dolly(value);
+        }
+        else if (command == "pan") {
+            camera.pan(value);
+        }
+        else if (command == "tilt") {
+            camera.tilt(value);
+        }
+        else {
+            camera.roll(value);
+        }
+        return respond("ok");
+    }
+    if (command == "reset_camera") {
+        state.camera = state.sceneCamera;
+        return respond("ok");
+    }
+    if (command == "resolution") {
+        SceneDimensions dimens;
+        if (!(words >> dimens.width >> dimens.height) || dimens.width <= 0 || dimens.height <= 0 ||
+            dimens.width > DAEMON_MAX_IMAGE_SIZE || dimens.height > DAEMON_MAX_IMAGE_SIZE) {
+            return respond("error resolution takes a width and a height from 1 to " +
+                std::to_string(DAEMON_MAX_IMAGE_SIZE));
+        }
+        state.dimens = dimens;
+        return respond("ok");
+    }
+    if (command == "render") {
+        std::string path;
+        std::getline(words >> std::ws, path);
+        state.scene->setView(state.camera, state.dimens);
+        SceneJob job(state.sceneFile);
+        job.scene = state.scene;
+        job.stats.sceneFile = state.sceneFile;
+        job.ppmImage = PPMImageI(state.dimens.width, state.dimens.height);
+        std::ostringstream log;
+        if (renderScene(job, pool, settings, log) != EXIT_SUCCESS) {
+            return respond("error rendering failed");
+        }
+        std::cout << log.str();
+        const std::string renderMs =
+            std::to_string(Timer::toMilliSec<double>(double(job.stats.phaseNanoSec[int(Phase::Render)])));
+        if (!path.empty()) {
+            std::ofstream imageFile(path, std::ios::out | std::ios::binary);
+            serializePPMImage(imageFile, job.ppmImage);
+            return imageFile.good() ? respond("ok " + renderMs + " " + path) : respond("error can't write " + path);
+        }
+        std::ostringstream image;
+        serializePPMImage(image, job.ppmImage);
+        const std::string imageBytes = image.str();
+        return respond("ok " + renderMs + " " + std::to_string(imageBytes.size())) && connection.write(imageBytes);
+    }
+    return respond("error unknown command " + command);
+}
+
+// Serves render requests on the Unix domain socket _socketPath_ until a client asks it to shut
+// down. Clients are served one at a time, one request per line, and the loaded scene stays
+// resident between requests and clients, so a request costs just its render. The requests are:
+//   load <scene file>  parses and builds a scene, responds ok <width> <height>
+//   truck|boom|dolly <distance>, pan|tilt|roll <degrees>  moves the camera
+//   reset_camera  restores the camera of the scene file
+//   resolution <width> <height>  sets the image size
+//   render [<path>]  renders the scene and writes it as a PPM image to _path_, responding
+//     ok <render ms> <path>, or without a path responds ok <render ms> <bytes> followed by the image
+//   quit  closes the connection, shutdown also stops the daemon
+// Failed requests are answered with error <reason>
+static int32_t runDaemon(const std::string& socketPath, ThreadPool& pool, const RenderSettings& settings) {
+    UnixSocketServer server;
+    if (!server.listen(socketPath)) {
+        return EXIT_FAILURE;
+    }
+    std::cout << "Listening on " << socketPath << std::endl;
+
+    DaemonState state;
+    bool shutdown = false;
+    while (!shutdown) {
+        const int fd = server.accept();
+        if (fd < 0) {
+            std::cerr << "Failed to accept a connection on " << socketPath << std::endl;
+            return EXIT_FAILURE;
+        }
+        SocketConnection connection(fd);
+        std::string request;
+        while (connection.readLine(request) &&
+            handleDaemonRequest(request, state, pool, settings, connection, shutdown)) {}
+        std::cout << std::flush;
+    }
     return EXIT_SUCCESS;
 }
 
-int main() {
-    const std::vector<std::string> inputFiles = {
-        "input/scene0.crtscene"/*, "input/scene1.crtscene", "input/scene2.crtscene",
-        "input/scene3.crtscene", "input/scene4.crtscene", "input/scene5.crtscene",
-        "input/scene6.crtscene", "input/scene7.crtscene", "input/scene8.crtscene"*/ };
+// Options given on the command line
+struct ProgramOptions {
+    CpuPath cpuPath = detectCpuPath();  // Path of the kernels to use, the best one by default
+    std::string traceFile;  // Chrome trace JSON file to write, none if empty
+    bool hwCounters = false;  // Counts hardware events of the phases with the CPU performance counters
+    TraceSettings traceSettings;  // Ray pruning and light sampling settings of the renders
+    bool batchShadowRays = false;  // Traces the shadow rays of each chunk together, grouped by light
+    bool useWavefront = false;  // Renders with the stage by stage WavefrontRenderer
+    int packetSize = DEFAULT_PACKET_SIZE;  // Camera rays traced together: 1 (none), 4 (2x2 pixels) or 8 (4x2 pixels)
+    bool recordTileCosts = false;  // Writes a heatmap and a CSV of the render time of each image tile
+    int antialiasSamples = 1;  // Stratified samples per axis traced through edge pixels, 1 turns antialiasing off
+    float antialiasThreshold = 0.1f;  // Color difference from a neighbour, as a fraction, that makes an edge
+    bool progressive = false;  // Renders passes of more and more pixels and writes a preview after each
+    int64_t timeBudgetMs = 0;  // Time budget of the render phase of each scene, 0 for none
+    size_t batchMemoryMB = BATCH_MEMORY_LIMIT_MB;  // Memory the scenes in flight of a batch may hold
+    std::string daemonSocket;  // Unix domain socket to serve render requests on, none if empty
+    bool animation = false;  // Renders the frames of a camera path instead of single images
+    std::string cameraPathFile;  // File of the camera path, the scene file itself if empty
+    std::vector<std::string> sceneFiles;  // Scenes to render, input/scene0.crtscene if none are given
+    BenchmarkOptions benchmark;
+};
 
-    RenderSettings renderSettings;
+static void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [--cpu-path=sse2|avx2|avx512] [--trace=<file>] [--hw-counters]"
+        << " [--min-ray-weight=<weight>] [--russian-roulette] [--min-light-contribution=<fraction>]"
+        << " [--light-samples=<n>] [--batch-shadow-rays] [--wavefront]"
+        << " [--packet-size=1|4|8] [--tile-costs] [--antialias=<samples>]"
+        << " [--antialias-threshold=<fraction>] [--progressive] [--time-budget=<ms>] [--batch-memory=<MB>] [--daemon=<socket>] [--animation[=<camera path>]] [--bench]"
+        << " [--bench-threads=<n>,<n>...] [--bench-runs=<n>] [--bench-report=<file>] [--bench-baseline=<file>]"
+        << " [--bench-tolerance=<fraction>] [<scene file>...]" << std::endl;
+}
 
-    ThreadPool pool(renderSettings.numThreads);
-    pool.start();
+// Parses _value_ of an option into _number_. Returns false unless all of it is a number
+template <typename T>
+static bool parseOptionValue(const std::string_view value, T& number) {
+    const auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), number);
+    return error == std::errc() && end == value.data() + value.size();
+}
 
-    for (const auto& file : inputFiles) {
-        if (runRenderer(file, pool, renderSettings) != EXIT_SUCCESS) {
-            std::cerr << "Failed to render file - " << file << std::endl;
+// Prints which of _options_ clash and returns EXIT_FAILURE if more than one of them is set. Each
+// option is given as its name and whether it is set
+static int32_t checkExclusive(const std::initializer_list<std::pair<const char*, bool>> options) {
+    const char* setOption = nullptr;
+    for (const auto& [name, isSet] : options) {
+        if (!isSet) {
+            continue;
+        }
+        if (setOption) {
+            std::cerr << name << " can't be combined with " << setOption << std::endl;
             return EXIT_FAILURE;
         }
+        setOption = name;
+    }
+    return EXIT_SUCCESS;
+}
+
+// Rejects the options that would be ignored or would make each other meaningless. A scene is
+// rendered by at most one of the progressive, time budget and wavefront modes, and the program
+// runs at most one of the benchmark, daemon and animation modes
+static int32_t checkModes(const ProgramOptions& options) {
+    const bool daemon = !options.daemonSocket.empty();
+    const bool timeBudget = options.timeBudgetMs > 0;
+    const bool benchmark = options.benchmark.enabled;
+    if (checkExclusive({ { "--progressive", options.progressive }, { "--time-budget", timeBudget },
+            { "--wavefront", options.useWavefront } }) != EXIT_SUCCESS ||
+        checkExclusive({ { "--bench", benchmark }, { "--daemon", daemon }, { "--animation", options.animation } }) !=
+            EXIT_SUCCESS ||
+        // the daemon loads the scenes its clients ask for and answers with the final images
+        checkExclusive({ { "--daemon", daemon }, { "scene files", !options.sceneFiles.empty() } }) != EXIT_SUCCESS ||
+        checkExclusive({ { "--daemon", daemon }, { "--progressive", options.progressive } }) != EXIT_SUCCESS ||
+        // the frames of an animation are rendered pixel by pixel
+        checkExclusive({ { "--animation", options.animation }, { "--progressive", options.progressive },
+            { "--time-budget", timeBudget }, { "--wavefront", options.useWavefront } }) != EXIT_SUCCESS ||
+        // a budget cuts the quality by the speed of each render, so the images of the thread counts would differ
+        checkExclusive({ { "--bench", benchmark }, { "--time-budget", timeBudget } }) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
     }
+    return EXIT_SUCCESS;
+}
 
-    pool.stop();
+// Parses the scene files to render and the options:
+//   --cpu-path=<name> picks the kernels of a specific path to benchmark it
+//   --trace=<file> records a timeline of the threads and writes it to _file_
+//   --hw-counters counts cycles, instructions, cache and branch misses of each phase (Linux only)
+//   --min-ray-weight=<weight> prunes the secondary rays of a lower weight, none are pruned by default.
+//     Pruning darkens long reflection and refraction paths unless --russian-roulette is given too
+//   --russian-roulette keeps pruned rays at random instead, scaling up the weight of the survivors.
+//     The rays are pruned below MIN_RAY_WEIGHT unless --min-ray-weight gives another weight
+//   --min-light-contribution=<fraction> culls the lights that can't add more to a pixel color,
+//     none are culled by default
+//   --light-samples=<n> shades each hit with _n_ lights picked at random instead of all of them
+//   --batch-shadow-rays queues the shadow rays of each chunk of pixels and traces them by light
+//   --wavefront renders batches of pixels stage by stage with the WavefrontRenderer
+//   --packet-size=<n> traces the camera rays of 2x2 (4) or 4x2 (8) pixels, or with --wavefront the
+//     queued rays in groups of _n_, together with the packet kernels of the CPU path, 1 traces
+//     them one by one. 8 by default, the fastest size on every CPU path
+//   --tile-costs writes <scene>.heatmap.ppm and <scene>.tiles.csv with the render time of each tile
+//   --antialias=<samples> traces _samples_ x _samples_ rays through each edge pixel
+//   --antialias-threshold=<fraction> sets the color difference from a neighbour that makes an edge
+//   --progressive renders in passes of more and more pixels, writing <scene>.pass<n>.ppm after each
+//   --time-budget=<ms> renders each scene within _ms_ milliseconds, reducing the quality as needed
+//   --batch-memory=<MB> bounds the memory held by the scenes in flight when rendering several
+//   --daemon=<socket> keeps running and renders the requests of clients of _socket_, see runDaemon
+//   --animation[=<file>] renders each scene along the camera path in _file_, a JSON sidecar, or
+//     in the "camera_path" of the scene file without one. See CameraPath for its format
+//   --bench renders every scene on 1, 2, 4 ... hardware threads and prints how the phases scale.
+//     The --bench-* options imply it and set the thread counts, the renders of each scene on each
+//     count of which the fastest is kept, the report to write, the report of an earlier run to
+//     compare with and the fraction by which a render may be slower than that one
+static int32_t parseOptions(int argc, char** argv, ProgramOptions& options) {
+    const CpuPath detectedPath = options.cpuPath;
+    BenchmarkOptions& benchmark = options.benchmark;
+    for (int i = 1; i < argc; i++) {
+        const std::string_view arg = argv[i];
+        const size_t equals = arg.find('=');
+        const std::string_view name = arg.substr(0, equals);
+        const std::string_view value = equals == std::string_view::npos ? "" : arg.substr(equals + 1);
+        benchmark.enabled |= name.substr(0, 7) == "--bench";
+        bool valid = true;
+        if (name.substr(0, 2) != "--") {
+            options.sceneFiles.emplace_back(arg);
+        }
+        else if (arg == "--hw-counters") {
+            options.hwCounters = true;
+        }
+        else if (name == "--min-ray-weight") {
+            float& minWeight = options.traceSettings.rayPruning.minWeight;
+            valid = parseOptionValue(value, minWeight) && minWeight >= 0.f;
+        }
+        else if (arg == "--russian-roulette") {
+            options.traceSettings.rayPruning.russianRoulette = true;
+        }
+        else if (name == "--min-light-contribution") {
+            float& minContribution = options.traceSettings.lightSampling.minContribution;
+            valid = parseOptionValue(value, minContribution) && minContribution >= 0.f;
+        }
+        else if (name == "--light-samples") {
+            int& numSamples = options.traceSettings.lightSampling.numSamples;
+            valid = parseOptionValue(value, numSamples) && numSamples > 0;
+        }
+        else if (arg == "--batch-shadow-rays") {
+            options.batchShadowRays = true;
+        }
+        else if (arg == "--wavefront") {
+            options.useWavefront = true;
+        }
+        else if (name == "--packet-size") {
+            valid = parseOptionValue(value, options.packetSize) &&
+                (options.packetSize == 1 || options.packetSize == 4 || options.packetSize == 8);
+        }
+        else if (arg == "--tile-costs") {
+            options.recordTileCosts = true;
+        }
+        else if (name == "--antialias") {
+            valid = parseOptionValue(value, options.antialiasSamples) && options.antialiasSamples > 0 &&
+                options.antialiasSamples <= MAX_ANTIALIAS_SAMPLES;
+        }
+        else if (name == "--antialias-threshold") {
+            valid = parseOptionValue(value, options.antialiasThreshold) && options.antialiasThreshold >= 0.f;
+        }
+        else if (arg == "--progressive") {
+            options.progressive = true;
+        }
+        else if (name == "--time-budget") {
+            // the budget is counted in nanoseconds
+            valid = parseOptionValue(value, options.timeBudgetMs) && options.timeBudgetMs > 0 &&
+                options.timeBudgetMs <= std::numeric_limits<int64_t>::max() / 1000000;
+        }
+        else if (name == "--batch-memory") {
+            valid = parseOptionValue(value, options.batchMemoryMB) && options.batchMemoryMB > 0 &&
+                options.batchMemoryMB <= std::numeric_limits<size_t>::max() / (1024 * 1024);
+        }
+        else if (name == "--animation") {
+            options.animation = true;
+            options.cameraPathFile = value;
+        }
+        else if (name == "--daemon") {
+            options.daemonSocket = value;
+            valid = !value.empty();
+        }
+        else if (name == "--trace") {
+            options.traceFile = value;
+            valid = !value.empty();
+        }
+        else if (name == "--cpu-path") {
+            if (!parseCpuPath(value, options.cpuPath)) {
+                std::cerr << "Unknown CPU path " << value << std::endl;
+                return EXIT_FAILURE;
+            }
+            if (int(options.cpuPath) > int(detectedPath)) {
+                std::cerr << "CPU path " << getCpuPathName(options.cpuPath) << " is not supported, the best one is "
+                    << getCpuPathName(detectedPath) << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+        else if (name == "--bench-threads") {
+            valid = parseThreadCounts(value, benchmark.threadCounts);
+        }
+        else if (name == "--bench-runs") {
+            valid = parseOptionValue(value, benchmark.numRuns) && benchmark.numRuns > 0;
+        }
+        else if (name == "--bench-report") {
+            benchmark.reportFile = value;
+            valid = !value.empty();
+        }
+        else if (name == "--bench-baseline") {
+            benchmark.baselineFile = value;
+            valid = !value.empty();
+        }
+        else if (name == "--bench-tolerance") {
+            valid = parseOptionValue(value, benchmark.tolerance) && benchmark.tolerance > 0.0 &&
+                std::isfinite(benchmark.tolerance);
+        }
+        else {
+            valid = arg == "--bench";
+        }
+
+        if (!valid) {
+            std::cerr << "Invalid argument " << arg << ". ";
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (checkModes(options) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    RayPruning& rayPruning = options.traceSettings.rayPruning;
+    if (rayPruning.russianRoulette && rayPruning.minWeight == 0.f) {
+        rayPruning.minWeight = MIN_RAY_WEIGHT;
+    }
+    if (options.sceneFiles.empty()) {
+        options.sceneFiles = { "input/scene0.crtscene" };
+    }
+    if (benchmark.threadCounts.empty()) {
+        benchmark.threadCounts = getDefaultThreadCounts(std::max(std::thread::hardware_concurrency(), 1u));
+    }
+    return EXIT_SUCCESS;
+}
+
+// Returns the settings of the renders on _numThreads_ threads that the options ask for
+static RenderSettings makeRenderSettings(const ProgramOptions& options, const unsigned numThreads) {
+    return RenderSettings{ .numThreads = numThreads, .traceSettings = options.traceSettings,
+        .batchShadowRays = options.batchShadowRays, .useWavefront = options.useWavefront,
+        .packetSize = options.packetSize, .recordTileCosts = options.recordTileCosts,
+        .antialiasSamples = options.antialiasSamples, .antialiasThreshold = options.antialiasThreshold,
+        .progressive = options.progressive, .timeBudgetMs = options.timeBudgetMs };
+}
+
+// Selects the kernels of the path given in the options. They trace ray packets only, so the log
+// tells when the options render without packets and leave them unused
+static void selectKernels(const ProgramOptions& options) {
+    const CpuPath detectedPath = detectCpuPath();
+    const CpuPath path = options.cpuPath;
+    selectCpuPath(path);
+    // the progressive and time budget modes trace single rays
+    const bool usesPackets = options.packetSize > 1 && !options.progressive && options.timeBudgetMs == 0;
+    std::cout << "CPU path: " << getKernels().name << " kernels (detected " << getCpuPathName(detectedPath)
+        << (path != detectedPath ? ", overridden" : "") << "), ";
+    if (usesPackets) {
+        std::cout << "used for the " << options.packetSize << " ray packets\n";
+    }
+    else {
+        std::cout << "unused without ray packets ("
+            << (options.packetSize > 1 ? "the mode traces single rays" : "--packet-size=1") << ")\n";
+    }
+}
+
+// Writes the recorded timeline to the trace file of the options
+static int32_t writeTrace(const ProgramOptions& options) {
+    TraceRecorder::get().stop();
+    std::ofstream traceFile(options.traceFile);
+    if (!traceFile.good()) {
+        std::cerr << "Failed to write " << options.traceFile << " file." << std::endl;
+        return EXIT_FAILURE;
+    }
+    TraceRecorder::get().writeJson(traceFile);
+    std::cout << "Trace written to " << options.traceFile << "\n";
+    return EXIT_SUCCESS;
+}
+
+// Renders every scene on every pool size of the benchmark options, keeping the fastest of the
+// runs of each, then prints the results and writes and compares the reports the options ask for
+static int32_t runBenchmarks(const ProgramOptions& options) {
+    const BenchmarkOptions& benchmark = options.benchmark;
+    BenchmarkReport report;
+    for (const unsigned numThreads : benchmark.threadCounts) {
+        const RenderSettings renderSettings = makeRenderSettings(options, numThreads);
+        ThreadPool pool(numThreads);
+        pool.start();
+
+        for (const std::string& file : options.sceneFiles) {
+            RenderStats fastest;
+            for (unsigned run = 0; run < benchmark.numRuns; run++) {
+                RenderStats stats;
+                if (runRenderer(file, pool, renderSettings, stats) != EXIT_SUCCESS) {
+                    std::cerr << "Failed to render file - " << file << std::endl;
+                    pool.stop();
+                    return EXIT_FAILURE;
+                }
+                if (run == 0 || stats.phaseNanoSec[int(Phase::Render)] < fastest.phaseNanoSec[int(Phase::Render)]) {
+                    fastest = stats;
+                }
+            }
+            report.add(fastest);
+        }
+
+        pool.stop();
+    }
+
+    report.print(std::cout);
+    int32_t status = report.checkImagesMatch(std::cerr) ? EXIT_SUCCESS : EXIT_FAILURE;
+    if (!benchmark.reportFile.empty() && report.writeJson(benchmark.reportFile) != EXIT_SUCCESS) {
+        status = EXIT_FAILURE;
+    }
+    if (!benchmark.baselineFile.empty() &&
+        report.compareBaseline(benchmark.baselineFile, benchmark.tolerance) != EXIT_SUCCESS) {
+        status = EXIT_FAILURE;
+    }
+    return status;
+}
+
+int main(int argc, char** argv) {
+    ProgramOptions options;
+    if (parseOptions(argc, argv, options) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    selectKernels(options);
+    if (options.hwCounters && !enableHwCounters()) {
+        std::cerr << "Hardware counters are not available, rendering without them" << std::endl;
+    }
+    if (!options.traceFile.empty()) {
+        TraceRecorder::get().start();
+        TraceRecorder::get().setThreadName("main");
+    }
+
+    int32_t status = EXIT_SUCCESS;
+    if (options.benchmark.enabled) {
+        status = runBenchmarks(options);
+    }
+    else {
+        const RenderSettings renderSettings = makeRenderSettings(options, getHardwareThreads());
+
+        ThreadPool pool(renderSettings.numThreads);
+        pool.start();
+
+        if (!options.daemonSocket.empty()) {
+            status = runDaemon(options.daemonSocket, pool, renderSettings);
+        }
+        else if (options.animation) {
+            for (const std::string& file : options.sceneFiles) {
+                const std::string& cameraPathFile = options.cameraPathFile.empty() ? file : options.cameraPathFile;
+                if (runAnimation(file, cameraPathFile, pool, renderSettings, options.batchMemoryMB * 1024 * 1024) !=
+                    EXIT_SUCCESS) {
+                    std::cerr << "Failed to render the animation of " << file << std::endl;
+                    status = EXIT_FAILURE;
+                    break;
+                }
+            }
+        }
+        else if (options.sceneFiles.size() > 1) {
+            if (options.hwCounters) {
+                std::cerr << "The stages of a batch overlap, so the hardware counters of each phase include the "
+                    << "work of the others" << std::endl;
+            }
+            BatchLimit limit(BATCH_MAX_SCENES_IN_FLIGHT, options.batchMemoryMB * 1024 * 1024);
+            status = runBatch(options.sceneFiles, pool, renderSettings, limit);
+        }
+        else {
+            RenderStats stats;
+            if (runRenderer(options.sceneFiles[0], pool, renderSettings, stats) != EXIT_SUCCESS) {
+                std::cerr << "Failed to render file - " << options.sceneFiles[0] << std::endl;
+                status = EXIT_FAILURE;
+            }
+        }
+
+        pool.stop();
+    }
+
+    if (!options.traceFile.empty() && writeTrace(options) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
 
-    return 0;
+    return status;
 }
\ No newline at end of file
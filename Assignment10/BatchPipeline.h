@@ -0,0 +1,87 @@
+#ifndef BATCHPIPELINE_H
+#define BATCHPIPELINE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+/// @brief Bounds the scenes of a batch in flight, from the end of their parsing until their image
+/// is written, by their number and by an estimate of the memory they hold. A scene always fits
+/// when no other one is in flight, so a scene larger than the memory limit still renders, alone.
+class BatchLimit {
+public:
+    BatchLimit() = delete;
+
+    BatchLimit(const size_t _maxScenes, const size_t _maxBytes) : maxScenes(_maxScenes), maxBytes(_maxBytes) {}
+
+    // Waits until a scene holding _bytes_ fits in the limits and counts it in
+    void acquire(const size_t bytes) {
+        std::unique_lock<std::mutex> lock(mutex);
+        fits.wait(lock, [this, bytes] {
+            return numScenes == 0 || (numScenes < maxScenes && numBytes + bytes <= maxBytes);
+        });
+        numScenes++;
+        numBytes += bytes;
+    }
+
+    // Counts out a scene that was acquired with _bytes_
+    void release(const size_t bytes) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            numScenes--;
+            numBytes -= bytes;
+        }
+        fits.notify_all();
+    }
+
+private:
+    const size_t maxScenes;
+    const size_t maxBytes;
+    std::mutex mutex;
+    std::condition_variable fits;
+    size_t numScenes = 0;
+    size_t numBytes = 0;
+};
+
+// Queue that hands items from one stage of a batch to the next. The producer closes it once it has
+// pushed its last item
+template <typename T>
+class StageQueue {
+public:
+    void push(T item) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            items.push_back(std::move(item));
+        }
+        changed.notify_one();
+    }
+
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+        }
+        changed.notify_all();
+    }
+
+    // Waits for the next item. Returns false once the queue is closed and empty
+    bool pop(T& item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this] { return closed || !items.empty(); });
+        if (items.empty()) {
+            return false;
+        }
+        item = std::move(items.front());
+        items.pop_front();
+        return true;
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<T> items;
+    bool closed = false;
+};
+
+#endif
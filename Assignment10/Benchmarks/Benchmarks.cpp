@@ -0,0 +1,448 @@
+// Microbenchmarks of the intersection, traversal, shading, camera and image output kernels on
+// randomized inputs with a fixed seed, so every run measures the same work.
+//
+// Builds on Linux from this directory with plain g++ (or clang++ with the same arguments) and the
+// header-only rapidjson the renderer uses:
+//   g++ -std=c++20 -O2 -pthread -I.. -I<rapidjson>/include -o benchmarks
+//       Benchmarks.cpp ../CRTCamera.cpp ../CRTTriangle.cpp ../Material.cpp ../Matrix3x3.cpp
+//       ../CpuDispatch.cpp ../PacketKernelsSSE2.cpp ../PacketKernelsAVX2.cpp ../PacketKernelsAVX512.cpp
+//
+// Usage: benchmarks [--baseline=<file>] [--write-baseline=<file>] [--tolerance=<fraction>]
+// With --baseline the median run of each benchmark is compared to the stored one, and the program
+// fails when any benchmark is slower than the baseline by more than the tolerance (0.1 by default)
+// or, for a benchmark whose runs spread wider than that, by more than NOISE_STDDEVS standard
+// deviations of its runs. The fastest run isn't compared, as a single lucky run sets it.
+// baseline.json next to this file holds the results of the machine the suite was written on.
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "PPMImage.h"
+#include "RayPacket.h"
+#include "Scene.h"
+#include "Timer.h"
+
+static constexpr uint64_t BENCHMARK_SEED = 0x5eed;
+static constexpr int NUM_RUNS = 15;        // Timed runs of each benchmark
+static constexpr int64_t MIN_RUN_NANOSEC = 20'000'000;  // Shortest timed run, fast work is repeated
+static constexpr size_t NUM_INPUTS = 4096;  // Rays, boxes, triangles or hits per run
+static constexpr int MESH_TRIANGLES = 1024;
+static constexpr double NOISE_STDDEVS = 2.0;  // Slowdown in standard deviations of the runs taken for noise
+
+// Result of a benchmark over all of its timed runs
+struct BenchmarkResult {
+    std::string name;
+    double nsPerOp;    // Median over the runs, which is less sensitive to outliers than the mean
+    double stdDevNs;   // Standard deviation of the ns/op of the runs
+    double minNsPerOp;
+};
+
+// Keeps the results of the benchmarked calls alive, so the compiler can't drop the calls
+static volatile uint64_t benchmarkSink;
+
+// Times _NUM_RUNS_ runs of _work_, which performs _opsPerWork_ operations and returns a value
+// depending on their results. Each run repeats the work enough times to last MIN_RUN_NANOSEC,
+// found by an untimed run that also warms up the caches
+template <typename F>
+static BenchmarkResult runBenchmark(const std::string& name, const size_t opsPerWork, F&& work) {
+    Timer warmupTimer;
+    benchmarkSink = benchmarkSink + work();
+    const int64_t workNanoSec = std::max<int64_t>(1, warmupTimer.getElapsedNanoSec());
+    const int64_t repeats = std::max<int64_t>(1, MIN_RUN_NANOSEC / workNanoSec);
+
+    std::vector<double> nsPerOp(NUM_RUNS);
+    for (int r = 0; r < NUM_RUNS; r++) {
+        Timer timer;
+        for (int64_t i = 0; i < repeats; i++) {
+            benchmarkSink = benchmarkSink + work();
+        }
+        nsPerOp[r] = double(timer.getElapsedNanoSec()) / (opsPerWork * repeats);
+    }
+
+    double mean = 0.0;
+    for (const double ns : nsPerOp) {
+        mean += ns / NUM_RUNS;
+    }
+    double variance = 0.0;
+    for (const double ns : nsPerOp) {
+        variance += (ns - mean) * (ns - mean) / (NUM_RUNS - 1);
+    }
+    std::sort(nsPerOp.begin(), nsPerOp.end());
+    return BenchmarkResult{ name, nsPerOp[NUM_RUNS / 2], std::sqrt(variance), nsPerOp[0] };
+}
+
+// Returns a random point in the box [-_extent_, _extent_]^3
+static Pointf randomPoint(RNG& rng, const float extent) {
+    return Pointf((2.f * rng.uniformFloat() - 1.f) * extent, (2.f * rng.uniformFloat() - 1.f) * extent,
+        (2.f * rng.uniformFloat() - 1.f) * extent);
+}
+
+// Returns a random ray from outside the unit box towards a random point inside it
+static CRTRay randomRay(RNG& rng) {
+    const Pointf origin = randomPoint(rng, 1.f) * 3.f;
+    CRTVectorf dir = randomPoint(rng, 1.f) - origin;
+    return CRTRay(origin, dir.normalize());
+}
+
+// Returns a mesh of _numTriangles_ random triangles of about _size_ inside the unit box
+static TriangleMesh randomMesh(RNG& rng, const int numTriangles, const float size, const int32_t materialIdx) {
+    std::vector<Pointf> vertPositions;
+    std::vector<TriangleIndices> vertIndices;
+    for (int t = 0; t < numTriangles; t++) {
+        const Pointf center = randomPoint(rng, 1.f - size);
+        for (int v = 0; v < 3; v++) {
+            vertPositions.push_back(center + randomPoint(rng, size));
+        }
+        vertIndices.push_back(TriangleIndices{ 3 * t, 3 * t + 1, 3 * t + 2 });
+    }
+    return TriangleMesh(vertPositions, vertIndices, materialIdx);
+}
+
+// Scene with one mesh of each material type, lit by a few point lights
+static Scene makeBenchmarkScene(RNG& rng) {
+    SceneParams sceneParams;
+    sceneParams.camera = CRTCamera(Pointf(0.f, 0.f, 3.f), Pointf(0.f), 1920, 1080);
+    sceneParams.settings.backgrColor = Colorf(0.1f);
+    sceneParams.settings.sceneDimensions = SceneDimensions{ 1920, 1080 };
+    for (int type = 0; type < NUM_MATERIAL_TYPES; type++) {
+        MaterialProperty property;
+        if (MaterialType(type) == MaterialType::Refractive) {
+            property.ior = 1.5f;
+        }
+        else {
+            property.albedo = Colorf(0.8f, 0.6f, 0.4f);
+        }
+        sceneParams.materials.emplace_back(property, true, MaterialType(type));
+        sceneParams.objects.push_back(randomMesh(rng, MESH_TRIANGLES / NUM_MATERIAL_TYPES, 0.1f, type));
+    }
+    for (int i = 0; i < 8; i++) {
+        sceneParams.lights.emplace_back(randomPoint(rng, 2.f), 1000);
+    }
+    return Scene(sceneParams);
+}
+
+// Intersection kernels of a single ray with a single triangle or box
+static void benchmarkIntersection(RNG& rng, std::vector<BenchmarkResult>& results) {
+    const TriangleMesh mesh = randomMesh(rng, int(NUM_INPUTS), 0.5f, 0);
+    const std::vector<TriangleIndices>& vertIndices = mesh.geometry->vertIndices;
+    std::vector<CRTRay> rays(NUM_INPUTS);
+    std::vector<BBox> boxes(NUM_INPUTS);
+    for (size_t i = 0; i < NUM_INPUTS; i++) {
+        rays[i] = randomRay(rng);
+        boxes[i] = BBox(randomPoint(rng, 1.f), randomPoint(rng, 1.f));
+    }
+
+    results.push_back(runBenchmark("Triangle::intersect", NUM_INPUTS, [&] {
+        uint64_t numHits = 0;
+        for (size_t i = 0; i < NUM_INPUTS; i++) {
+            InfoIntersect info;
+            numHits += Triangle(vertIndices[i], &mesh).intersect(rays[i], info);
+        }
+        return numHits;
+    }));
+    results.push_back(runBenchmark("Triangle::intersectMT", NUM_INPUTS, [&] {
+        uint64_t numHits = 0;
+        for (size_t i = 0; i < NUM_INPUTS; i++) {
+            InfoIntersect info;
+            numHits += Triangle(vertIndices[i], &mesh).intersectMT(rays[i], info);
+        }
+        return numHits;
+    }));
+    results.push_back(runBenchmark("BBox::intersect", NUM_INPUTS, [&] {
+        uint64_t numHits = 0;
+        for (size_t i = 0; i < NUM_INPUTS; i++) {
+            numHits += boxes[i].intersect(rays[i]);
+        }
+        return numHits;
+    }));
+}
+
+// Closest hit searches through a whole mesh and a whole scene
+static void benchmarkTraversal(RNG& rng, const Scene& scene, std::vector<BenchmarkResult>& results) {
+    const TriangleMesh mesh = randomMesh(rng, MESH_TRIANGLES, 0.1f, 0);
+    std::vector<CRTRay> rays(NUM_INPUTS);
+    for (CRTRay& ray : rays) {
+        ray = randomRay(rng);
+    }
+
+    results.push_back(runBenchmark("TriangleMesh::intersect (1K triangles)", NUM_INPUTS, [&] {
+        uint64_t numHits = 0;
+        for (const CRTRay& ray : rays) {
+            ray.tMax = MAX_FLOAT;
+            InfoIntersect info;
+            numHits += mesh.intersect(ray, info);
+        }
+        return numHits;
+    }));
+    results.push_back(runBenchmark("Scene::intersect (1K triangles)", NUM_INPUTS, [&] {
+        uint64_t numHits = 0;
+        for (const CRTRay& ray : rays) {
+            ray.tMax = MAX_FLOAT;
+            InfoIntersect info;
+            numHits += scene.intersect(ray, info);
+        }
+        return numHits;
+    }));
+    results.push_back(runBenchmark("Scene::intersectPrim (1K triangles)", NUM_INPUTS, [&] {
+        uint64_t numHits = 0;
+        for (const CRTRay& ray : rays) {
+            numHits += scene.intersectPrim(ray);
+        }
+        return numHits;
+    }));
+}
+
+// Closest hit searches of camera ray blocks through the scene, one ray at a time and as packets
+// with the kernels of every CPU path the machine supports
+template <int N>
+static void benchmarkPackets(RNG& rng, const Scene& scene, std::vector<BenchmarkResult>& results) {
+    constexpr uint32_t width = N / 2;
+    const SceneDimensions& dimens = scene.getSceneDimensions();
+    std::vector<RayPacket<N>> packets(NUM_INPUTS / N);
+    for (RayPacket<N>& packet : packets) {
+        const uint32_t row = rng.uniformUInt32() % (dimens.height / 2) * 2;
+        const uint32_t col = rng.uniformUInt32() % (dimens.width / width) * width;
+        packet.setCameraRays(scene.getCamera(), row, col, width);
+    }
+
+    results.push_back(runBenchmark("Scene::intersect (" + std::to_string(N) + " ray blocks)", NUM_INPUTS, [&] {
+        uint64_t numHits = 0;
+        for (const RayPacket<N>& packet : packets) {
+            for (int lane = 0; lane < N; lane++) {
+                InfoIntersect info;
+                numHits += scene.intersect(packet.getRay(lane), info);
+            }
+        }
+        return numHits;
+    }));
+
+    const CpuPath detectedPath = detectCpuPath();
+    for (int path = 0; path <= int(detectedPath); path++) {
+        selectCpuPath(CpuPath(path));
+        const PacketKernels<N>& kernels = getPacketKernels<N>();
+        const std::string name = "intersectPacket<" + std::to_string(N) + "> (" + getCpuPathName(CpuPath(path)) + ")";
+        results.push_back(runBenchmark(name, NUM_INPUTS, [&] {
+            uint64_t numHits = 0;
+            for (const RayPacket<N>& cameraPacket : packets) {
+                RayPacket<N> packet = cameraPacket;
+                PacketHits<N> hits;
+                intersectPacket(&scene, kernels, packet, hits);
+                for (int lane = 0; lane < N; lane++) {
+                    numHits += hits.meshIdx[lane] >= 0;
+                }
+            }
+            return numHits;
+        }));
+    }
+    selectCpuPath(detectedPath);
+}
+
+// Shading of scene hits on each material type, including the shadow rays of the diffuse ones
+static void benchmarkShading(RNG& rng, const Scene& scene, std::vector<BenchmarkResult>& results) {
+    // collects hits of each material type from random rays
+    std::vector<std::pair<CRTRay, InfoIntersect>> hits[NUM_MATERIAL_TYPES];
+    for (int numFull = 0; numFull < NUM_MATERIAL_TYPES;) {
+        const CRTRay ray = randomRay(rng);
+        InfoIntersect info;
+        if (!scene.intersect(ray, info))
+            continue;
+        const int type = int(scene.getMaterialTable().getRef(info.materialIdx).type);
+        if (hits[type].size() < NUM_INPUTS) {
+            hits[type].emplace_back(ray, info);
+            numFull += hits[type].size() == NUM_INPUTS;
+        }
+    }
+
+    static const char* shadeNames[NUM_MATERIAL_TYPES] = { "shade diffuse", "shade reflective",
+        "shade refractive", "shade constant" };
+    const TraceSettings traceSettings;
+    for (int type = 0; type < NUM_MATERIAL_TYPES; type++) {
+        results.push_back(runBenchmark(shadeNames[type], NUM_INPUTS, [&] {
+            TraceContext context(traceSettings, BENCHMARK_SEED);
+            float sum = 0.f;
+            for (const auto& [ray, info] : hits[type]) {
+                sum += shade(ray, &scene, info, Colorf(1.f), context).x;
+                while (!context.rayStack.empty()) {
+                    sum += context.rayStack.pop().weight.x;
+                }
+            }
+            return uint64_t(sum);
+        }));
+    }
+}
+
+// Camera ray generation, one pixel at a time and a row of pixels at once
+static void benchmarkCamera(RNG& rng, const Scene& scene, std::vector<BenchmarkResult>& results) {
+    const CRTCamera& camera = scene.getCamera();
+    const SceneDimensions& dimens = scene.getSceneDimensions();
+    std::vector<std::pair<uint32_t, uint32_t>> pixels(NUM_INPUTS);
+    for (auto& [row, col] : pixels) {
+        row = rng.uniformUInt32() % dimens.height;
+        col = rng.uniformUInt32() % dimens.width;
+    }
+
+    results.push_back(runBenchmark("CRTCamera::getRay", NUM_INPUTS, [&] {
+        float sum = 0.f;
+        for (const auto& [row, col] : pixels) {
+            sum += camera.getRay(row, col).dir.x;
+        }
+        return uint64_t(std::abs(sum));
+    }));
+
+    std::vector<float> dirX(dimens.width), dirY(dimens.width), dirZ(dimens.width);
+    results.push_back(runBenchmark("CRTCamera::getTileRayDirs (per ray)", size_t(dimens.width) * 16, [&] {
+        float sum = 0.f;
+        for (uint32_t row = 0; row < 16; row++) {
+            camera.getTileRayDirs(row, 0, 1, dimens.width, dirX.data(), dirY.data(), dirZ.data());
+            sum += dirX[row];
+        }
+        return uint64_t(std::abs(sum));
+    }));
+}
+
+// Writing a random 320x180 image in the PPM text format to memory
+static void benchmarkSerialization(RNG& rng, std::vector<BenchmarkResult>& results) {
+    PPMImageI image(320, 180);
+    for (PPMPixelI& pixel : image.data) {
+        pixel.color = Colori(rng.uniformUInt32() % 256, rng.uniformUInt32() % 256, rng.uniformUInt32() % 256);
+    }
+
+    results.push_back(runBenchmark("serializePPMImage (320x180)", 1, [&] {
+        std::ostringstream out;
+        serializePPMImage(out, image);
+        return uint64_t(out.tellp());
+    }));
+}
+
+static void printResults(const std::vector<BenchmarkResult>& results) {
+    std::cout << std::left << std::setw(40) << "benchmark" << std::right << std::setw(14) << "ns/op"
+        << std::setw(10) << "+-%" << std::setw(14) << "min ns/op" << std::setw(16) << "ops/s" << "\n";
+    for (const BenchmarkResult& result : results) {
+        std::cout << std::left << std::setw(40) << result.name << std::right << std::fixed << std::setprecision(2)
+            << std::setw(14) << result.nsPerOp << std::setw(10) << 100.0 * result.stdDevNs / result.nsPerOp
+            << std::setw(14) << result.minNsPerOp << std::setw(16) << std::setprecision(0)
+            << 1e9 / result.nsPerOp << "\n";
+    }
+    std::cout.unsetf(std::ios::floatfield);
+}
+
+static int32_t writeBaseline(const std::string& fileName, const std::vector<BenchmarkResult>& results) {
+    std::ofstream out(fileName);
+    if (!out.good()) {
+        std::cerr << "Failed to write " << fileName << " file." << std::endl;
+        return EXIT_FAILURE;
+    }
+    out << "{\n  \"benchmarks\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+        out << (i ? ",\n" : "\n") << "    { \"name\": \"" << results[i].name << "\", \"ns_per_op\": "
+            << results[i].nsPerOp << ", \"stddev_ns\": " << results[i].stdDevNs << ", \"min_ns_per_op\": "
+            << results[i].minNsPerOp << " }";
+    }
+    out << "\n  ]\n}\n";
+    std::cout << "Baseline written to " << fileName << "\n";
+    return EXIT_SUCCESS;
+}
+
+// Compares the medians of the results with the baseline. Returns EXIT_FAILURE if the baseline
+// can't be read or a benchmark got slower by more than _tolerance_ and by more than the noise of
+// its runs in either measurement
+static int32_t compareBaseline(const std::string& fileName, const std::vector<BenchmarkResult>& results,
+    const double tolerance) {
+    std::ifstream in(fileName);
+    if (!in.good()) {
+        std::cerr << "Failed to read " << fileName << " file." << std::endl;
+        return EXIT_FAILURE;
+    }
+    BasicIStreamWrapper<std::ifstream> istreamWrapper(in);
+    Document doc;
+    doc.ParseStream(istreamWrapper);
+    if (doc.HasParseError() || !doc.IsObject() || !doc.HasMember("benchmarks") ||
+        !doc.FindMember("benchmarks")->value.IsArray()) {
+        std::cerr << "Failed to parse " << fileName << " file." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const Value& baseline = doc.FindMember("benchmarks")->value;
+    int numRegressions = 0;
+    std::cout << "Compared to " << fileName << ":\n";
+    for (const BenchmarkResult& result : results) {
+        double baselineNs = 0.0;
+        double baselineStdDevNs = 0.0;
+        for (size_t i = 0; i < baseline.Size(); i++) {
+            if (result.name == baseline[i].FindMember("name")->value.GetString()) {
+                baselineNs = baseline[i].FindMember("ns_per_op")->value.GetDouble();
+                baselineStdDevNs = baseline[i].FindMember("stddev_ns")->value.GetDouble();
+            }
+        }
+        std::cout << "  " << std::left << std::setw(40) << result.name << std::right;
+        if (baselineNs <= 0.0) {
+            std::cout << "not in baseline\n";
+            continue;
+        }
+        const double change = result.nsPerOp / baselineNs - 1.0;
+        const double noise = NOISE_STDDEVS *
+            std::max(baselineStdDevNs / baselineNs, result.stdDevNs / result.nsPerOp);
+        const double allowedChange = std::max(tolerance, noise);
+        const bool regression = change > allowedChange;
+        numRegressions += regression;
+        std::cout << std::showpos << std::fixed << std::setprecision(1) << 100.0 * change << "%"
+            << std::noshowpos << " (allowed " << 100.0 * allowedChange << "%)"
+            << (regression ? "  REGRESSION" : "") << "\n";
+    }
+    std::cout.unsetf(std::ios::floatfield);
+
+    if (numRegressions > 0) {
+        std::cerr << numRegressions << " benchmarks are slower than the baseline by more than "
+            << 100.0 * tolerance << "% and the noise of their runs" << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char** argv) {
+    std::string baselineFile, writeBaselineFile;
+    double tolerance = 0.1;
+    for (int i = 1; i < argc; i++) {
+        const std::string_view arg = argv[i];
+        if (arg.substr(0, 11) == "--baseline=") {
+            baselineFile = arg.substr(11);
+        }
+        else if (arg.substr(0, 17) == "--write-baseline=") {
+            writeBaselineFile = arg.substr(17);
+        }
+        else if (arg.substr(0, 12) == "--tolerance=") {
+            tolerance = std::atof(argv[i] + 12);
+        }
+        else {
+            std::cerr << "Unknown argument " << arg << ". Usage: " << argv[0]
+                << " [--baseline=<file>] [--write-baseline=<file>] [--tolerance=<fraction>]" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    RNG rng(BENCHMARK_SEED);
+    const Scene scene = makeBenchmarkScene(rng);
+    std::vector<BenchmarkResult> results;
+    benchmarkIntersection(rng, results);
+    benchmarkTraversal(rng, scene, results);
+    benchmarkPackets<4>(rng, scene, results);
+    benchmarkPackets<8>(rng, scene, results);
+    benchmarkShading(rng, scene, results);
+    benchmarkCamera(rng, scene, results);
+    benchmarkSerialization(rng, results);
+    printResults(results);
+
+    if (!writeBaselineFile.empty() && writeBaseline(writeBaselineFile, results) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    if (!baselineFile.empty()) {
+        return compareBaseline(baselineFile, results, tolerance);
+    }
+    return EXIT_SUCCESS;
+}
@@ -38,15 +38,55 @@ public:
         aspectRatio = imageWidth / (float)imageHeight;
     }
 
-    CRTRay getRay(const uint32_t x, const uint32_t y) const {
-        const float ndcX = (y + 0.5f) / imageWidth;
-        const float ndcY = (x + 0.5f) / imageHeight;
+    // Changes the size of the image the camera renders, keeping its position and orientation
+    void setImageSize(const int _imageWidth, const int _imageHeight) {
+        imageWidth = _imageWidth;
+        imageHeight = _imageHeight;
+        aspectRatio = imageWidth / (float)imageHeight;
+    }
+
+    // Returns the ray through pixel row _x_ and column _y_, at _rowOffset_ and _colOffset_ in [0, 1)
+    // from its top left corner, which is the pixel center by default
+    CRTRay getRay(const uint32_t x, const uint32_t y, const float rowOffset = 0.5f,
+        const float colOffset = 0.5f) const {
+        const float ndcX = (y + colOffset) / imageWidth;
+        const float ndcY = (x + rowOffset) / imageHeight;
         const float screenX = (2.f * ndcX - 1.f) * aspectRatio;
         const float screenY = (1.f - 2.f * ndcY);
         const CRTVectorf rayDir(screenX, screenY, -1);
         return CRTRay(lookFrom, (rayDir * rotationM).normalize());
     }
 
+    // Writes the normalized directions of the rays through the centers of the _numRows_ x
+    // _numCols_ pixel tile starting at pixel (_row_, _col_) to _dirX_, _dirY_ and _dirZ_ in
+    // row-major order. All of the rays start at getLookFrom(). The directions are computed with
+    // the same operations as in getRay, so the packet and single ray renders give the same image
+    void getTileRayDirs(const uint32_t row, const uint32_t col, const uint32_t numRows,
+        const uint32_t numCols, float* dirX, float* dirY, float* dirZ) const {
+        const float(&m)[3][3] = rotationM.m;
+        for (uint32_t r = 0; r < numRows; r++) {
+            const float screenY = 1.f - 2.f * ((row + r + 0.5f) / imageHeight);
+            float* rowDirX = dirX + size_t(r) * numCols;
+            float* rowDirY = dirY + size_t(r) * numCols;
+            float* rowDirZ = dirZ + size_t(r) * numCols;
+            for (uint32_t c = 0; c < numCols; c++) {
+                const float screenX = (2.f * ((col + c + 0.5f) / imageWidth) - 1.f) * aspectRatio;
+                rowDirX[c] = screenX * m[0][0] + screenY * m[1][0] + -1.f * m[2][0];
+                rowDirY[c] = screenX * m[0][1] + screenY * m[1][1] + -1.f * m[2][1];
+                rowDirZ[c] = screenX * m[0][2] + screenY * m[1][2] + -1.f * m[2][2];
+            }
+        }
+
+        // kept as a separate loop over plain arrays so that it is vectorized
+        const size_t numRays = size_t(numRows) * numCols;
+        for (size_t i = 0; i < numRays; i++) {
+            const float invLength = 1.f / sqrtf(dirX[i] * dirX[i] + dirY[i] * dirY[i] + dirZ[i] * dirZ[i]);
+            dirX[i] *= invLength;
+            dirY[i] *= invLength;
+            dirZ[i] *= invLength;
+        }
+    }
+
     void truck(const float sidewayStep) { lookFrom += rotationM * CRTVectorf(sidewayStep, 0.f, 0.f); }
 
     void boom(const float upDownStep) { lookFrom += rotationM * CRTVectorf(0.f, upDownStep, 0.f); }
@@ -1,11 +1,38 @@
 #include "CRTTriangle.h"
 #include "Material.h"
+#include "RenderStats.h"
+#include "TraceRecorder.h"
+#include <algorithm>
 #include <chrono>
+#include <numeric>
+
+// Spreads the lower 10 bits of _x_ so that there are two zero bits between each of them
+// source https://github.com/mmp/pbrt-v3/blob/master/src/accelerators/bvh.cpp
+inline static uint32_t leftShift3(uint32_t x) {
+    if (x == (1 << 10))
+        --x;
+    x = (x | (x << 16)) & 0b00000011000000000000000011111111;
+    x = (x | (x << 8)) & 0b00000011000000001111000000001111;
+    x = (x | (x << 4)) & 0b00000011000011000011000011000011;
+    x = (x | (x << 2)) & 0b00001001001001001001001001001001;
+    return x;
+}
+
+// Computes 30-bit Morton code of point _p_ with coordinates in [0, 1]
+inline static uint32_t encodeMorton3(const CRTVectorf& p) {
+    constexpr float mortonScale = 1 << 10;
+    const uint32_t x = leftShift3(uint32_t(p.x * mortonScale));
+    const uint32_t y = leftShift3(uint32_t(p.y * mortonScale));
+    const uint32_t z = leftShift3(uint32_t(p.z * mortonScale));
+    return (z << 2) | (y << 1) | x;
+}
+
+MeshGeometry::MeshGeometry(std::vector<Pointf> _vertPositions,
+    std::vector<TriangleIndices> _vertIndices)
+    : vertPositions(std::move(_vertPositions)), vertIndices(std::move(_vertIndices)) {
+    CRT_TRACE_SCOPE("build mesh geometry", "build", "triangles", int64_t(vertIndices.size()));
+    optimizeLayout();
 
-TriangleMesh::TriangleMesh(const std::vector<Pointf>& _vertPositions,
-    const std::vector<TriangleIndices>& _vertIndices,
-    const int32_t _materialIdx)
-    : vertPositions(_vertPositions), vertIndices(_vertIndices), materialIdx(_materialIdx) {
     vertNormals.resize(vertPositions.size());
     for (size_t i = 0; i < vertIndices.size(); i++) {
         const CRTVectorf& A = vertPositions[vertIndices[i][0]];
@@ -31,10 +58,51 @@ TriangleMesh::TriangleMesh(const std::vector<Pointf>& _vertPositions,
     }
 }
 
+void MeshGeometry::optimizeLayout() {
+    // computes the triangle centroids and their bounds
+    std::vector<Pointf> centroids(vertIndices.size());
+    BBox centroidBounds;
+    for (size_t i = 0; i < vertIndices.size(); i++) {
+        centroids[i] = (vertPositions[vertIndices[i][0]] + vertPositions[vertIndices[i][1]] +
+            vertPositions[vertIndices[i][2]]) / 3.f;
+        centroidBounds.expandBy(centroids[i]);
+    }
+
+    // sorts the triangles along the Morton curve of their centroids
+    std::vector<std::pair<uint32_t, uint32_t>> mortonTriangles(vertIndices.size());
+    for (size_t i = 0; i < vertIndices.size(); i++) {
+        mortonTriangles[i] = { encodeMorton3(centroidBounds.offset(centroids[i])), uint32_t(i) };
+    }
+    std::stable_sort(mortonTriangles.begin(), mortonTriangles.end(),
+        [](const auto& t1, const auto& t2) { return t1.first < t2.first; });
+
+    // renumbers the vertices in order of first use by the sorted triangles,
+    // vertices not referenced by any triangle are dropped
+    std::vector<int> newVertIdx(vertPositions.size(), -1);
+    std::vector<Pointf> sortedPositions;
+    std::vector<TriangleIndices> sortedIndices;
+    sortedPositions.reserve(vertPositions.size());
+    sortedIndices.reserve(vertIndices.size());
+    for (const auto& [code, triangleIdx] : mortonTriangles) {
+        TriangleIndices indices = vertIndices[triangleIdx];
+        for (int& vertIdx : indices) {
+            if (newVertIdx[vertIdx] < 0) {
+                newVertIdx[vertIdx] = int(sortedPositions.size());
+                sortedPositions.push_back(vertPositions[vertIdx]);
+            }
+            vertIdx = newVertIdx[vertIdx];
+        }
+        sortedIndices.push_back(indices);
+    }
+
+    vertPositions = std::move(sortedPositions);
+    vertIndices = std::move(sortedIndices);
+}
+
 std::vector<Triangle> TriangleMesh::getTriangles() const {
     std::vector<Triangle> triangles;
-    triangles.reserve(vertIndices.size());
-    std::for_each(vertIndices.begin(), vertIndices.end(),
+    triangles.reserve(geometry->vertIndices.size());
+    std::for_each(geometry->vertIndices.begin(), geometry->vertIndices.end(),
         [&](const TriangleIndices& currTriangleIndices) -> void {
             triangles.emplace_back(currTriangleIndices, this);
         });
@@ -43,10 +111,13 @@ std::vector<Triangle> TriangleMesh::getTriangles() const {
 
 bool TriangleMesh::intersect(const CRTRay& ray, InfoIntersect& info) const {
     // early return if ray does not intersect with the object bounds
-    if (!bounds.intersect(ray))
+    CRT_COUNT(BoundsTests, 1);
+    if (!geometry->bounds.intersect(ray))
         return false;
 
     bool hasIntersect = false;
+    const std::vector<TriangleIndices>& vertIndices = geometry->vertIndices;
+    CRT_COUNT(TriangleTests, vertIndices.size());
     for (size_t i = 0; i < vertIndices.size(); i++) {
         const Triangle triangle(vertIndices[i], this);
         if (triangle.intersectMT(ray, info)) {
@@ -61,20 +132,24 @@ bool TriangleMesh::intersect(const CRTRay& ray, InfoIntersect& info) const {
 }
 
 bool TriangleMesh::intersectPrim(const CRTRay& ray, InfoIntersect& info) const {
+    const std::vector<TriangleIndices>& vertIndices = geometry->vertIndices;
     for (size_t i = 0; i < vertIndices.size(); i++) {
         const Triangle triangle(vertIndices[i], this);
         if (triangle.intersectMT(ray, info)) {
+            CRT_COUNT(TriangleTests, i + 1);
             return true;
         }
     }
+    CRT_COUNT(TriangleTests, vertIndices.size());
     return false;
 }
 
 bool Triangle::intersect(const CRTRay& ray, InfoIntersect& info) const {
     // takes out the triangle's vertices
-    const CRTVectorf& A = mesh->vertPositions[indices[0]];
-    const CRTVectorf& B = mesh->vertPositions[indices[1]];
-    const CRTVectorf& C = mesh->vertPositions[indices[2]];
+    const MeshGeometry& geometry = *mesh->geometry;
+    const CRTVectorf& A = geometry.vertPositions[indices[0]];
+    const CRTVectorf& B = geometry.vertPositions[indices[1]];
+    const CRTVectorf& C = geometry.vertPositions[indices[2]];
 
     const CRTVectorf AB = B - A;
     const CRTVectorf AC = C - A;
@@ -126,9 +201,9 @@ bool Triangle::intersect(const CRTRay& ray, InfoIntersect& info) const {
         return false;
 
     // takes out the triangle's vertex normals
-    const CRTVectorf& v0N = mesh->vertNormals[indices[0]];
-    const CRTVectorf& v1N = mesh->vertNormals[indices[1]];
-    const CRTVectorf& v2N = mesh->vertNormals[indices[2]];
+    const CRTVectorf& v0N = geometry.vertNormals[indices[0]];
+    const CRTVectorf& v1N = geometry.vertNormals[indices[1]];
+    const CRTVectorf& v2N = geometry.vertNormals[indices[2]];
 
     // records intersection data
     info.pos = P;
@@ -144,9 +219,10 @@ bool Triangle::intersect(const CRTRay& ray, InfoIntersect& info) const {
 
 bool Triangle::intersectMT(const CRTRay& ray, InfoIntersect& info) const {
     // takes out the triangle's vertices
-    const CRTVectorf& A = mesh->vertPositions[indices[0]];
-    const CRTVectorf& B = mesh->vertPositions[indices[1]];
-    const CRTVectorf& C = mesh->vertPositions[indices[2]];
+    const MeshGeometry& geometry = *mesh->geometry;
+    const CRTVectorf& A = geometry.vertPositions[indices[0]];
+    const CRTVectorf& B = geometry.vertPositions[indices[1]];
+    const CRTVectorf& C = geometry.vertPositions[indices[2]];
 
     const CRTVectorf AB = B - A;
     const CRTVectorf AC = C - A;
@@ -185,9 +261,9 @@ bool Triangle::intersectMT(const CRTRay& ray, InfoIntersect& info) const {
     CRTVectorf N = cross(AB, AC);
 
     // takes out the triangle's vertex normals
-    const Normalf& v0N = mesh->vertNormals[indices[0]];
-    const Normalf& v1N = mesh->vertNormals[indices[1]];
-    const Normalf& v2N = mesh->vertNormals[indices[2]];
+    const Normalf& v0N = geometry.vertNormals[indices[0]];
+    const Normalf& v1N = geometry.vertNormals[indices[1]];
+    const Normalf& v2N = geometry.vertNormals[indices[2]];
 
     // records intersection data
     info.pos = P;
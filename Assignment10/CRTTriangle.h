@@ -3,6 +3,7 @@
 
 #include <array>
 #include <cstdint>
+#include <memory>
 #include <vector>
 #include "AABBox.h"
 #include "CRTVector.h"
@@ -20,6 +21,7 @@ struct InfoIntersect {
     float t = MAX_FLOAT;  
     float u, v;             // Barycentric coordinates
     int32_t materialIdx;   
+    int32_t objectIdx = -1;  // Index of the hit object in the scene, set by Scene::intersect
 };
 
 struct TriangleMesh;
@@ -40,19 +42,45 @@ struct Triangle {
     bool intersectMT(const CRTRay& ray, InfoIntersect& info) const;
 };
 
-/// @brief Triangle mesh class that stores information for each object in the scene
-struct TriangleMesh {
+/// @brief Geometry of a triangle mesh. Objects with identical geometry share one instance
+struct MeshGeometry {
     std::vector<Pointf> vertPositions;        // Positions of the vertices in world space
     std::vector<TriangleIndices> vertIndices;  //  Keeps indices for each triangle in the mesh
     std::vector<Normalf> vertNormals;         // Pre-computed normals for each vertex in the mesh
+    BBox bounds;                              // The bounding box of the mesh
+
+    MeshGeometry() = delete;
+
+    // Initializes mesh geometry from vertex positions and vertex indices
+    MeshGeometry(std::vector<Pointf> _vertPositions, std::vector<TriangleIndices> _vertIndices);
+
+    // Returns the number of bytes used by the geometry buffers
+    size_t memoryUsage() const {
+        return vertPositions.size() * sizeof(Pointf) + vertIndices.size() * sizeof(TriangleIndices) +
+            vertNormals.size() * sizeof(Normalf);
+    }
+
+private:
+    // Reorders triangles along a Morton curve over their centroids and renumbers vertices
+    // in first-use order, so neighbouring triangles reference neighbouring vertex data
+    void optimizeLayout();
+};
+
+/// @brief Triangle mesh class that stores information for each object in the scene
+struct TriangleMesh {
+    std::shared_ptr<const MeshGeometry> geometry;  // Vertex data, possibly shared with other objects
     int32_t materialIdx;  // Index from the materials list that characterise current object (mesh)
-    BBox bounds;          // The bounding box of the mesh
 
     TriangleMesh() = delete;
 
+    // Initializes triangle mesh from shared geometry and material index
+    TriangleMesh(std::shared_ptr<const MeshGeometry> _geometry, const int32_t _materialIdx)
+        : geometry(std::move(_geometry)), materialIdx(_materialIdx) {}
+
     // Initializes triangle mesh from vertex positions, vertex indices, and material index
     TriangleMesh(const std::vector<Pointf>& _vertPositions,
-        const std::vector<TriangleIndices>& _vertIndices, const int32_t _materialIdx);
+        const std::vector<TriangleIndices>& _vertIndices, const int32_t _materialIdx)
+        : TriangleMesh(std::make_shared<MeshGeometry>(_vertPositions, _vertIndices), _materialIdx) {}
 
     // Retrieves list of all triangles in the mesh upon request
     std::vector<Triangle> getTriangles() const;
@@ -145,4 +145,6 @@ typedef CRTVector<float> Normalf;
 typedef CRTVector<int> Colori;
 typedef CRTVector<int> Normali;
 
+#include "CRTVectorSSE.h"
+
 #endif
@@ -0,0 +1,148 @@
+#ifndef CAMERAPATH_H
+#define CAMERAPATH_H
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "CRTCamera.h"
+#include "rapidjson/document.h"
+#include "rapidjson/istreamwrapper.h"
+
+// Moves of a camera away from the camera of the scene file. Distances are in scene units and
+// angles in degrees, as taken by the CRTCamera functions of the same names
+struct CameraMoves {
+    float truck = 0.f;
+    float boom = 0.f;
+    float dolly = 0.f;
+    float pan = 0.f;
+    float tilt = 0.f;
+    float roll = 0.f;
+};
+
+// Camera moves of a frame of the animation
+struct CameraKeyframe {
+    int frame;
+    CameraMoves moves;
+};
+
+/// @brief Keyframed path of the camera of an animation. Frames between two keyframes get the
+/// moves interpolated linearly between theirs, frames before the first keyframe or after the
+/// last one get the moves of that keyframe.
+class CameraPath {
+public:
+    // Parses a camera path from _fileName_, either the "camera_path" object of a scene file or a
+    // sidecar JSON file holding just that object:
+    //   { "frames": 48, "keyframes": [ { "frame": 0 }, { "frame": 47, "pan": 30, "dolly": -2 } ] }
+    // Moves left out of a keyframe are 0
+    int32_t parse(const std::string& fileName) {
+        std::ifstream in(fileName);
+        if (!in.good()) {
+            std::cerr << "Failed to read " << fileName << " file." << std::endl;
+            return EXIT_FAILURE;
+        }
+        rapidjson::BasicIStreamWrapper<std::ifstream> istreamWrapper(in);
+        rapidjson::Document doc;
+        doc.ParseStream(istreamWrapper);
+        if (doc.HasParseError() || !doc.IsObject()) {
+            std::cerr << "Failed to parse " << fileName << " file." << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        const rapidjson::Value& path = doc.HasMember(SceneConstants::STR_CAMERA_PATH) ?
+            doc.FindMember(SceneConstants::STR_CAMERA_PATH)->value : doc;
+        if (!path.IsObject() || !path.HasMember(SceneConstants::STR_PATH_FRAMES) ||
+            !path.FindMember(SceneConstants::STR_PATH_FRAMES)->value.IsInt() ||
+            !path.HasMember(SceneConstants::STR_PATH_KEYFRAMES) ||
+            !path.FindMember(SceneConstants::STR_PATH_KEYFRAMES)->value.IsArray()) {
+            std::cerr << "Failed to parse the camera path of " << fileName << " file." << std::endl;
+            return EXIT_FAILURE;
+        }
+        numFrames = path.FindMember(SceneConstants::STR_PATH_FRAMES)->value.GetInt();
+        if (numFrames <= 0) {
+            std::cerr << "The camera path of " << fileName << " has no frames." << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        keyframes.clear();
+        for (const rapidjson::Value& keyframe : path.FindMember(SceneConstants::STR_PATH_KEYFRAMES)->value.GetArray()) {
+            if (!keyframe.IsObject() || !keyframe.HasMember(SceneConstants::STR_KEYFRAME_FRAME) ||
+                !keyframe.FindMember(SceneConstants::STR_KEYFRAME_FRAME)->value.IsInt()) {
+                std::cerr << "Failed to parse a keyframe of " << fileName << " file." << std::endl;
+                return EXIT_FAILURE;
+            }
+            CameraKeyframe parsed{ keyframe.FindMember(SceneConstants::STR_KEYFRAME_FRAME)->value.GetInt(), {} };
+            CameraMoves& moves = parsed.moves;
+            if (!parseMove(keyframe, "truck", moves.truck) || !parseMove(keyframe, "boom", moves.boom) ||
+                !parseMove(keyframe, "dolly", moves.dolly) || !parseMove(keyframe, "pan", moves.pan) ||
+                !parseMove(keyframe, "tilt", moves.tilt) || !parseMove(keyframe, "roll", moves.roll)) {
+                std::cerr << "Failed to parse the moves of keyframe " << parsed.frame << " of " << fileName
+                    << " file." << std::endl;
+                return EXIT_FAILURE;
+            }
+            keyframes.push_back(parsed);
+        }
+        if (keyframes.empty()) {
+            std::cerr << "The camera path of " << fileName << " has no keyframes." << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::stable_sort(keyframes.begin(), keyframes.end(),
+            [](const CameraKeyframe& k1, const CameraKeyframe& k2) { return k1.frame < k2.frame; });
+        return EXIT_SUCCESS;
+    }
+
+    int getNumFrames() const { return numFrames; }
+
+    // Returns the moves of _frame_, interpolated between the keyframes around it
+    CameraMoves getMoves(const int frame) const {
+        const auto next = std::find_if(keyframes.begin(), keyframes.end(),
+            [frame](const CameraKeyframe& keyframe) { return keyframe.frame > frame; });
+        if (next == keyframes.begin()) {
+            return next->moves;
+        }
+        const CameraKeyframe& prev = *(next - 1);
+        if (next == keyframes.end()) {
+            return prev.moves;
+        }
+        const float t = float(frame - prev.frame) / (next->frame - prev.frame);
+        const auto lerp = [t](const float from, const float to) { return from + (to - from) * t; };
+        const CameraMoves& from = prev.moves;
+        const CameraMoves& to = next->moves;
+        return CameraMoves{ lerp(from.truck, to.truck), lerp(from.boom, to.boom), lerp(from.dolly, to.dolly),
+            lerp(from.pan, to.pan), lerp(from.tilt, to.tilt), lerp(from.roll, to.roll) };
+    }
+
+    // Returns the camera of _frame_: _sceneCamera_ moved along its own axes, then panned, tilted
+    // and rolled
+    CRTCamera getCamera(const CRTCamera& sceneCamera, const int frame) const {
+        const CameraMoves moves = getMoves(frame);
+        CRTCamera camera = sceneCamera;
+        camera.truck(moves.truck);
+        camera.boom(moves.boom);
+        camera.dolly(moves.dolly);
+        camera.pan(moves.pan);
+        camera.tilt(moves.tilt);
+        camera.roll(moves.roll);
+        return camera;
+    }
+
+private:
+    // Reads the move _name_ of _keyframe_ into _value_ if it has one. Returns false if it isn't a number
+    static bool parseMove(const rapidjson::Value& keyframe, const char* name, float& value) {
+        if (!keyframe.HasMember(name)) {
+            return true;
+        }
+        const rapidjson::Value& move = keyframe.FindMember(name)->value;
+        if (!move.IsNumber()) {
+            return false;
+        }
+        value = move.GetFloat();
+        return true;
+    }
+
+    int numFrames = 0;
+    std::vector<CameraKeyframe> keyframes;  // Sorted by frame
+};
+
+#endif
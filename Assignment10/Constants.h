@@ -17,9 +17,29 @@ static constexpr float SHADOW_BIAS = 1e-2f;
 static constexpr float REFLECTION_BIAS = 1e-3f;
 static constexpr float REFRACTION_BIAS = 1e-4f;
 static constexpr int MAX_RAY_DEPTH = 4;
+static constexpr int RAY_STACK_SIZE = 2 * (MAX_RAY_DEPTH + 2);  // Enough for a ray tree of MAX_RAY_DEPTH
+static constexpr float MIN_RAY_WEIGHT = 1.f / MAX_COLOR_COMP;  // Russian roulette weight when none is given, lower can't change the pixel
+static constexpr float MIN_LIGHT_CONTRIBUTION = 0.25f / MAX_COLOR_COMP;  // Contribution too small to change a pixel, culled by the time budget
 static constexpr size_t PIXELS_PER_THREAD = 16;
+static constexpr int MAX_ANTIALIAS_SAMPLES = 16;  // Most stratified samples per axis of an edge pixel
+static constexpr int COST_TILE_SIZE = 16;  // Side in pixels of the tiles the render cost is recorded for
+static constexpr int PROGRESSIVE_NUM_PASSES = 3;  // Passes of progressive rendering, the first traces 1 of 4^(passes - 1) pixels
+static constexpr size_t BATCH_MAX_SCENES_IN_FLIGHT = 3;  // Scenes of a batch built but not yet written: to render, rendering and writing
+static constexpr int DEFAULT_PACKET_SIZE = 8;  // Camera rays traced together by default, the fastest size on every CPU path
+static constexpr size_t BATCH_MEMORY_LIMIT_MB = 2048;  // Default memory the scenes of a batch in flight may hold
+static constexpr size_t ANIMATION_MIN_PIXELS_PER_THREAD = 128 * 128;  // Fewer pixels per thread render more frames at once instead
+static constexpr int DAEMON_MAX_IMAGE_SIZE = 16384;  // Largest image side the render daemon accepts
+static constexpr int DEADLINE_TILE_SIZE = 16;  // Side in pixels of the tiles handed out when rendering with a time budget
+static constexpr int DEADLINE_REDUCED_RAY_DEPTH = 2;  // Ray depth once the budget forces fewer bounces
+static constexpr float DEADLINE_LIGHT_CULL_SCALE = 16.f;  // Scale of MIN_LIGHT_CONTRIBUTION once the budget forces light culling
+static constexpr int DEADLINE_SUBSAMPLE_STEP = 4;  // Side of the blocks of pixels sharing one traced pixel at the lowest quality
+static constexpr float DEADLINE_EDGE_FRACTION = 0.1f;  // Fraction of edge pixels expected when projecting the antialiasing time
+static constexpr float DEADLINE_MEASURE_FRACTION = 0.05f;  // Fraction of the pixels rendered at a level before its speed is trusted
+static constexpr float DEADLINE_COST_QUANTILE = 0.95f;  // Quantile of the tile costs that caps the costliest tiles in the projection
+static constexpr float WELD_EPSILON = 0.f;  // Vertices closer than this are merged on import, 0 merges exact duplicates only
+static constexpr float WELD_NORMAL_COS = 0.99999f;  // Cosine between smoothed normals below which close vertices stay split
 static constexpr float MAX_FLOAT = std::numeric_limits<float>::max();
-static constexpr float MIN_FLOAT = std::numeric_limits<float>::min();
+static constexpr float MIN_FLOAT = std::numeric_limits<float>::lowest();
 
 namespace SceneConstants {
     inline const char* STR_SCENE_SETTINGS = "settings";
@@ -42,6 +62,10 @@ namespace SceneConstants {
     inline const char* STR_MATERIAL_IDX = "material_index";
     inline const char* STR_VERTICES = "vertices";
     inline const char* STR_TRIANGLE_INDICES = "triangles";
+    inline const char* STR_CAMERA_PATH = "camera_path";
+    inline const char* STR_PATH_FRAMES = "frames";
+    inline const char* STR_PATH_KEYFRAMES = "keyframes";
+    inline const char* STR_KEYFRAME_FRAME = "frame";
 };  
 
 #endif  
\ No newline at end of file
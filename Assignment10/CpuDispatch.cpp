@@ -0,0 +1,80 @@
+#include "CpuDispatch.h"
+#include "Constants.h"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define CRT_HAS_CPUID 1
+
+static void cpuid(int info[4], const int leaf, const int subLeaf) { __cpuidex(info, leaf, subLeaf); }
+
+static uint64_t getEnabledXStateFeatures() { return _xgetbv(0); }
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#define CRT_HAS_CPUID 1
+
+static void cpuid(int info[4], const int leaf, const int subLeaf) {
+    __cpuid_count(leaf, subLeaf, info[0], info[1], info[2], info[3]);
+}
+
+static uint64_t getEnabledXStateFeatures() {
+    uint32_t eax = 0, edx = 0;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (uint64_t(edx) << 32) | eax;
+}
+#endif
+
+CpuPath detectCpuPath() {
+#ifdef CRT_HAS_CPUID
+    int info[4] = {};
+    cpuid(info, 0, 0);
+    const int maxLeaf = info[0];
+    if (maxLeaf < 7) {
+        return CpuPath::SSE2;
+    }
+
+    cpuid(info, 1, 0);
+    const bool osXSave = (info[2] >> 27) & 1;
+    if (!osXSave) {
+        return CpuPath::SSE2;
+    }
+    // the OS has to save the wide registers on context switches, not only the CPU support them
+    const uint64_t xStateFeatures = getEnabledXStateFeatures();
+    const bool osYmm = (xStateFeatures & 0x6) == 0x6;     // SSE and AVX state
+    const bool osZmm = (xStateFeatures & 0xe6) == 0xe6;   // and the AVX-512 opmask and upper ZMM state
+
+    cpuid(info, 7, 0);
+    const bool avx2 = (info[1] >> 5) & 1;
+    const bool avx512f = (info[1] >> 16) & 1;
+    const bool avx512vl = (info[1] >> 31) & 1;
+    if (osZmm && avx2 && avx512f && avx512vl) {
+        return CpuPath::AVX512;
+    }
+    if (osYmm && avx2) {
+        return CpuPath::AVX2;
+    }
+#endif
+    return CpuPath::SSE2;
+}
+
+static CpuPath selectedPath = CpuPath::SSE2;
+static KernelSet selectedKernels = makeKernelSetSSE2();
+
+void selectCpuPath(const CpuPath path) {
+    Assert(int(path) <= int(detectCpuPath()) && "selectCpuPath() recieved a path the CPU doesn't support.");
+    selectedPath = path;
+    switch (path) {
+    case CpuPath::AVX512:
+        selectedKernels = makeKernelSetAVX512();
+        break;
+    case CpuPath::AVX2:
+        selectedKernels = makeKernelSetAVX2();
+        break;
+    default:
+        selectedKernels = makeKernelSetSSE2();
+        break;
+    }
+}
+
+CpuPath getSelectedCpuPath() { return selectedPath; }
+
+const KernelSet& getKernels() { return selectedKernels; }
@@ -0,0 +1,51 @@
+#ifndef CPUDISPATCH_H
+#define CPUDISPATCH_H
+
+#include <string_view>
+#include "PacketKernels.h"
+
+// Instruction sets the kernels are compiled for, from the most to the least widely supported
+enum class CpuPath : int { SSE2, AVX2, AVX512, Count };
+
+inline static const char* getCpuPathName(const CpuPath path) {
+    static const char* pathNames[int(CpuPath::Count)] = { "sse2", "avx2", "avx512" };
+    return pathNames[int(path)];
+}
+
+// Parses a path name as printed by getCpuPathName. Returns false for an unknown name
+inline static bool parseCpuPath(std::string_view name, CpuPath& path) {
+    for (int i = 0; i < int(CpuPath::Count); i++) {
+        if (name == getCpuPathName(CpuPath(i))) {
+            path = CpuPath(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Returns the best path the CPU and the OS support, checked through cpuid and xgetbv
+CpuPath detectCpuPath();
+
+// Makes the kernels of _path_ the ones returned by getKernels. Must be called before rendering
+// starts, and only with a path that is not better than detectCpuPath(). Only the ray packet
+// kernels are dispatched, the single ray intersection and shading code is built for the baseline
+// instruction set of the project
+void selectCpuPath(CpuPath path);
+
+CpuPath getSelectedCpuPath();
+
+// Returns the kernels of the selected path, the SSE2 ones until selectCpuPath is called
+const KernelSet& getKernels();
+
+template <int N>
+inline static const PacketKernels<N>& getPacketKernels() {
+    static_assert(N == 4 || N == 8, "Packet kernels are compiled for 4 and 8 rays only");
+    if constexpr (N == 4) {
+        return getKernels().packet4;
+    }
+    else {
+        return getKernels().packet8;
+    }
+}
+
+#endif
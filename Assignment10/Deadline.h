@@ -0,0 +1,237 @@
+#ifndef DEADLINE_H
+#define DEADLINE_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <numeric>
+#include <vector>
+#include "Material.h"
+#include "RenderStats.h"
+#include "Timer.h"
+
+// Quality levels of rendering with a time budget, from the quality of the render settings down.
+// Each level keeps the reductions of the ones before it
+enum class QualityLevel : int { Full, ReducedRayDepth, ReducedAntialias, CulledLights, Minimal, Subsampled, Count };
+
+inline static const char* getQualityLevelName(const QualityLevel level) {
+    static const char* levelNames[int(QualityLevel::Count)] = { "full", "reduced_ray_depth", "reduced_antialias",
+        "culled_lights", "minimal", "subsampled" };
+    return levelNames[int(level)];
+}
+
+// Pixels of the image covered by a tile, clipped to the image, and the quality level it is rendered at
+struct ImageTile {
+    int row;
+    int col;
+    int numRows;
+    int numCols;
+    int level;
+};
+
+/// @brief Keeps a render within a time budget counted from its construction. Hands out the image
+/// tiles to the render threads one at a time, measures how long each takes and projects when the
+/// render will end, including the antialiasing pass that follows. Whenever the projection exceeds
+/// the budget, the tiles taken from then on are rendered at the next quality level: fewer ray
+/// bounces, then fewer antialiasing samples, then more lights culled, then no bounces from the
+/// camera rays or antialiasing, and last one traced pixel per block of pixels. The levels only go
+/// down, so a render can't alternate between qualities, and a level is only left on a projection
+/// that a few slow tiles can't sway: the costliest tiles count at the DEADLINE_COST_QUANTILE
+/// quantile of the tile costs. The tiles are handed out in a scattered order, so the speed measured
+/// on the first ones is a fair sample of the whole image and not of its top rows.
+class DeadlineController {
+public:
+    DeadlineController() = delete;
+    DeadlineController(const DeadlineController&) = delete;
+    DeadlineController& operator=(const DeadlineController&) = delete;
+
+    DeadlineController(const int64_t _budgetNanoSec, const TraceSettings& traceSettings, const int antialiasSamples,
+        const int _width, const int _height, const unsigned _numThreads)
+        : budgetNanoSec(_budgetNanoSec), width(_width), height(_height),
+        tilesPerRow((_width + DEADLINE_TILE_SIZE - 1) / DEADLINE_TILE_SIZE),
+        numTiles(tilesPerRow * ((_height + DEADLINE_TILE_SIZE - 1) / DEADLINE_TILE_SIZE)),
+        numPixels(size_t(_width) * _height), numThreads(_numThreads), tileStride(getTileStride(numTiles)),
+        // the speed is trusted once every thread rendered a few tiles at the level
+        minLevelPixels(std::max(size_t(numPixels * DEADLINE_MEASURE_FRACTION),
+            size_t(4) * _numThreads * DEADLINE_TILE_SIZE * DEADLINE_TILE_SIZE)) {
+        levelSettings.fill(traceSettings);
+        for (int level = 0; level < int(QualityLevel::Count); level++) {
+            TraceSettings& settings = levelSettings[level];
+            int& samples = levelAntialiasSamples[level];
+            samples = antialiasSamples;
+            if (level >= int(QualityLevel::ReducedRayDepth)) {
+                settings.maxRayDepth = std::min(settings.maxRayDepth, DEADLINE_REDUCED_RAY_DEPTH);
+            }
+            if (level >= int(QualityLevel::ReducedAntialias)) {
+                samples = std::min(samples, 2);
+            }
+            if (level >= int(QualityLevel::CulledLights)) {
+                float& minContribution = settings.lightSampling.minContribution;
+                minContribution = std::max(minContribution, MIN_LIGHT_CONTRIBUTION) * DEADLINE_LIGHT_CULL_SCALE;
+            }
+            if (level >= int(QualityLevel::Minimal)) {
+                // not even the camera rays are reflected or refracted
+                settings.maxRayDepth = -1;
+                samples = 1;
+            }
+        }
+    }
+
+    // Takes the next tile to render. Returns false once every tile is taken
+    bool nextTile(ImageTile& tile) {
+        const size_t tileIdx = nextTileIdx.fetch_add(1, std::memory_order_relaxed);
+        if (tileIdx >= numTiles) {
+            return false;
+        }
+        // the stride is coprime with the number of tiles, so every tile is visited once
+        const size_t scatteredIdx = tileIdx * tileStride % numTiles;
+        tile.row = int(scatteredIdx / tilesPerRow) * DEADLINE_TILE_SIZE;
+        tile.col = int(scatteredIdx % tilesPerRow) * DEADLINE_TILE_SIZE;
+        tile.numRows = std::min(DEADLINE_TILE_SIZE, height - tile.row);
+        tile.numCols = std::min(DEADLINE_TILE_SIZE, width - tile.col);
+        tile.level = level.load(std::memory_order_relaxed);
+        return true;
+    }
+
+    // Returns the trace settings of quality level _tileLevel_
+    const TraceSettings& getTraceSettings(const int tileLevel) const { return levelSettings[tileLevel]; }
+
+    // Returns the trace settings of the current quality level
+    const TraceSettings& getTraceSettings() const { return getTraceSettings(level.load(std::memory_order_relaxed)); }
+
+    // Returns the side of the blocks of pixels of which only the top left one is traced and
+    // copied to the others at quality level _tileLevel_, 1 if every pixel is traced
+    static int getPixelStep(const int tileLevel) {
+        return tileLevel == int(QualityLevel::Subsampled) ? DEADLINE_SUBSAMPLE_STEP : 1;
+    }
+
+    // Records that _tile_ was rendered in _tileNanoSec_ by one thread, and moves to the next
+    // quality level if the render is projected to take longer than the budget at the current one
+    void tileDone(const ImageTile& tile, const int64_t tileNanoSec) {
+        std::lock_guard<std::mutex> lock(mutex);
+        const size_t numTilePixels = size_t(tile.numRows) * tile.numCols;
+        donePixels += numTilePixels;
+        const int currLevel = level.load(std::memory_order_relaxed);
+        // a tile taken before the last level change tells nothing about the speed of the current one
+        if (tile.level != currLevel) {
+            return;
+        }
+        levelTileCosts.push_back(double(tileNanoSec) / numTilePixels);
+        levelPixels += numTilePixels;
+        // the projection sorts the costs, so it is made once per tile of each thread
+        if (currLevel == int(QualityLevel::Subsampled) || levelPixels < minLevelPixels ||
+            ++tilesSinceProjection < numThreads) {
+            return;
+        }
+        tilesSinceProjection = 0;
+
+        const int64_t elapsed = timer.getElapsedNanoSec();
+        const double nanoSecPerPixel = getLevelNanoSecPerPixel();
+        const int samples = levelAntialiasSamples[currLevel];
+        const double antialiasNanoSec =
+            samples > 1 ? DEADLINE_EDGE_FRACTION * numPixels * samples * samples * nanoSecPerPixel : 0.0;
+        const double projectedNanoSec = elapsed + (numPixels - donePixels) * nanoSecPerPixel + antialiasNanoSec;
+        if (projectedNanoSec > budgetNanoSec) {
+            lowerLevel(currLevel, elapsed);
+        }
+    }
+
+    // Returns the samples per axis to antialias _numEdgePixels_ with in the time left, fewer than
+    // the ones of the current quality level if those don't fit. Returns 1 for no antialiasing.
+    // Must be called once every tile is done
+    int planAntialias(const size_t numEdgePixels) {
+        const int64_t elapsed = timer.getElapsedNanoSec();
+        const int currLevel = level.load(std::memory_order_relaxed);
+        // the speed of the current level if enough of its pixels were rendered to tell
+        const double nanoSecPerPixel = levelPixels >= minLevelPixels ?
+            getLevelNanoSecPerPixel() : double(elapsed) / std::max<size_t>(donePixels, 1);
+        int samples = levelAntialiasSamples[currLevel];
+        while (samples > 1 && numEdgePixels * samples * samples * nanoSecPerPixel > budgetNanoSec - elapsed) {
+            samples--;
+        }
+        if (samples < levelAntialiasSamples[currLevel]) {
+            degradations.push_back(Degradation{ samples > 1 ? "fewer_antialias_samples" : "no_antialias", 1.0,
+                elapsed });
+        }
+        antialiasSamples = samples;
+        return samples;
+    }
+
+    DeadlineReport getReport() const { return DeadlineReport{ budgetNanoSec, degradations, antialiasSamples }; }
+
+private:
+    // Moves from _currLevel_ to the next level that renders faster than it
+    void lowerLevel(const int currLevel, const int64_t elapsed) {
+        int next = currLevel + 1;
+        while (next < int(QualityLevel::Subsampled) && isSameQuality(next, currLevel)) {
+            next++;
+        }
+        degradations.push_back(Degradation{ getQualityLevelName(QualityLevel(next)), double(donePixels) / numPixels,
+            elapsed });
+        levelTileCosts.clear();
+        levelPixels = 0;
+        tilesSinceProjection = 0;
+        level.store(next, std::memory_order_relaxed);
+    }
+
+    // Returns the time per pixel of the image at the current level with all threads rendering,
+    // from the costs of its tiles. The tiles above the DEADLINE_COST_QUANTILE quantile of the
+    // costs count at that quantile, so a tile slowed down by something other than its pixels,
+    // like its thread being preempted, can't lower the quality of the rest of the image
+    double getLevelNanoSecPerPixel() {
+        const auto quantile = levelTileCosts.begin() + ptrdiff_t(DEADLINE_COST_QUANTILE * (levelTileCosts.size() - 1));
+        std::nth_element(levelTileCosts.begin(), quantile, levelTileCosts.end());
+        const double maxCost = *quantile;
+        double totalCost = 0.0;
+        for (const double cost : levelTileCosts) {
+            totalCost += std::min(cost, maxCost);
+        }
+        return totalCost / levelTileCosts.size() / numThreads;
+    }
+
+    // Returns an odd stride near the golden ratio of _numTiles_ that is coprime with it
+    static size_t getTileStride(const size_t numTiles) {
+        size_t stride = size_t(numTiles * 0.618) | 1;
+        while (std::gcd(stride, numTiles) != 1) {
+            stride += 2;
+        }
+        return stride;
+    }
+
+    // Returns whether two levels render the same, as the reduction of a level changes nothing
+    // when the render settings are already below it
+    bool isSameQuality(const int level1, const int level2) const {
+        const TraceSettings& settings1 = levelSettings[level1];
+        const TraceSettings& settings2 = levelSettings[level2];
+        return settings1.maxRayDepth == settings2.maxRayDepth &&
+            settings1.lightSampling.minContribution == settings2.lightSampling.minContribution &&
+            levelAntialiasSamples[level1] == levelAntialiasSamples[level2];
+    }
+
+    const Timer timer;
+    const int64_t budgetNanoSec;
+    const int width;
+    const int height;
+    const size_t tilesPerRow;
+    const size_t numTiles;
+    const size_t numPixels;
+    const unsigned numThreads;
+    const size_t tileStride;  // Step between the tiles handed out one after another
+    const size_t minLevelPixels;  // Pixels rendered at a level before its speed is trusted
+    std::array<TraceSettings, int(QualityLevel::Count)> levelSettings;
+    std::array<int, int(QualityLevel::Count)> levelAntialiasSamples{};
+    std::atomic<size_t> nextTileIdx{ 0 };
+    std::atomic<int> level{ int(QualityLevel::Full) };
+
+    std::mutex mutex;  // Guards the progress below, which the render threads update
+    size_t donePixels = 0;
+    std::vector<double> levelTileCosts;  // Time per pixel of each tile rendered at the current level
+    size_t levelPixels = 0;  // Pixels of the tiles in levelTileCosts
+    unsigned tilesSinceProjection = 0;
+    std::vector<Degradation> degradations;
+    int antialiasSamples = 1;  // Samples per axis chosen by planAntialias
+};
+
+#endif
@@ -0,0 +1,166 @@
+#include "HardwareCounters.h"
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+// Perf event type and config of each counter
+static const std::array<std::pair<uint32_t, uint64_t>, int(HwCounter::Count)> hwCounterEvents = { {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+} };
+
+static std::atomic_bool hwCountersEnabled = false;
+static std::array<bool, int(HwCounter::Count)> hwCounterAvailable{};
+
+// Opens _counter_ for the calling thread, counting user space code only. Returns -1 on failure
+static int openHwCounter(const HwCounter counter) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = hwCounterEvents[int(counter)].first;
+    attr.config = hwCounterEvents[int(counter)].second;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+}
+
+// Returns the count of the counter _fd_, scaled up for the time the counter wasn't running when
+// there are more events than the CPU can count at once
+static uint64_t readHwCounter(const int fd) {
+    uint64_t values[3] = {};  // Count, time enabled, time running
+    if (fd < 0 || read(fd, values, sizeof(values)) != ssize_t(sizeof(values)) || values[2] == 0) {
+        return 0;
+    }
+    return values[1] == values[2] ? values[0] : uint64_t(double(values[0]) * values[1] / values[2]);
+}
+
+// Counters of a thread, which register themselves until the thread exits
+struct ThreadHwCounters {
+    std::array<int, int(HwCounter::Count)> fds;
+
+    ThreadHwCounters();
+    ~ThreadHwCounters();
+
+    HwCounterValues read() const {
+        HwCounterValues values;
+        for (int i = 0; i < int(HwCounter::Count); i++) {
+            values.counts[i] = readHwCounter(fds[i]);
+        }
+        return values;
+    }
+};
+
+// Keeps track of the counters of every thread, like StatRegistry does for the render counters
+static std::mutex registryMutex;
+static std::vector<const ThreadHwCounters*> threadCounters;
+static HwCounterValues exitedThreadValues;
+
+ThreadHwCounters::ThreadHwCounters() {
+    for (int i = 0; i < int(HwCounter::Count); i++) {
+        fds[i] = hwCounterAvailable[i] ? openHwCounter(HwCounter(i)) : -1;
+    }
+    std::lock_guard<std::mutex> lock(registryMutex);
+    threadCounters.push_back(this);
+}
+
+ThreadHwCounters::~ThreadHwCounters() {
+    const HwCounterValues values = read();
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        for (int i = 0; i < int(HwCounter::Count); i++) {
+            exitedThreadValues.counts[i] += values.counts[i];
+        }
+        threadCounters.erase(std::find(threadCounters.begin(), threadCounters.end(), this));
+    }
+    for (const int fd : fds) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+}
+
+static ThreadHwCounters& getThreadHwCounters() {
+    thread_local ThreadHwCounters counters;
+    return counters;
+}
+
+bool enableHwCounters() {
+    bool anyAvailable = false;
+    for (int i = 0; i < int(HwCounter::Count); i++) {
+        const int fd = openHwCounter(HwCounter(i));
+        hwCounterAvailable[i] = fd >= 0;
+        anyAvailable |= fd >= 0;
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+    hwCountersEnabled = anyAvailable;
+    openThreadHwCounters();
+    return anyAvailable;
+}
+
+bool isHwCountersEnabled() { return hwCountersEnabled; }
+
+bool isHwCounterAvailable(const HwCounter counter) { return hwCounterAvailable[int(counter)]; }
+
+void openThreadHwCounters() {
+    if (hwCountersEnabled) {
+        getThreadHwCounters();
+    }
+}
+
+void pauseThreadHwCounters() {
+    if (hwCountersEnabled) {
+        for (const int fd : getThreadHwCounters().fds) {
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+}
+
+void resumeThreadHwCounters() {
+    if (hwCountersEnabled) {
+        for (const int fd : getThreadHwCounters().fds) {
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+HwCounterValues sampleHwCounters() {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    HwCounterValues total = exitedThreadValues;
+    for (const ThreadHwCounters* counters : threadCounters) {
+        const HwCounterValues values = counters->read();
+        for (int i = 0; i < int(HwCounter::Count); i++) {
+            total.counts[i] += values.counts[i];
+        }
+    }
+    return total;
+}
+#else
+bool enableHwCounters() { return false; }
+
+bool isHwCountersEnabled() { return false; }
+
+bool isHwCounterAvailable(HwCounter) { return false; }
+
+void openThreadHwCounters() {}
+
+void pauseThreadHwCounters() {}
+
+void resumeThreadHwCounters() {}
+
+HwCounterValues sampleHwCounters() { return HwCounterValues(); }
+#endif
@@ -0,0 +1,61 @@
+#ifndef HARDWARECOUNTERS_H
+#define HARDWARECOUNTERS_H
+
+#include <array>
+#include <cstdint>
+
+// Hardware events counted by the CPU performance counters
+enum class HwCounter : int { Cycles, Instructions, L1DMisses, LLCMisses, BranchMisses, Count };
+
+inline static const char* getHwCounterName(const HwCounter counter) {
+    static const char* counterNames[int(HwCounter::Count)] = { "cycles", "instructions", "l1d_misses",
+        "llc_misses", "branch_misses" };
+    return counterNames[int(counter)];
+}
+
+// Counts of the hardware events, summed over all counted threads
+struct HwCounterValues {
+    std::array<uint64_t, int(HwCounter::Count)> counts{};
+
+    uint64_t operator[](const HwCounter counter) const { return counts[int(counter)]; }
+
+    HwCounterValues operator-(const HwCounterValues& other) const {
+        HwCounterValues diff;
+        for (int i = 0; i < int(HwCounter::Count); i++) {
+            diff.counts[i] = counts[i] - other.counts[i];
+        }
+        return diff;
+    }
+
+    // Returns the instructions per cycle
+    double getIPC() const {
+        const uint64_t cycles = counts[int(HwCounter::Cycles)];
+        return cycles > 0 ? double(counts[int(HwCounter::Instructions)]) / cycles : 0.0;
+    }
+};
+
+// The counters are read through perf_event_open and are available only on Linux. Counting is off
+// until enableHwCounters is called, and then covers the user space code of every thread that
+// opened its counters with openThreadHwCounters.
+
+// Turns counting on and opens the counters of the calling thread. Returns false if the OS or the
+// CPU supports none of the events, in which case counting stays off
+bool enableHwCounters();
+
+bool isHwCountersEnabled();
+
+// Returns whether _counter_ could be opened, only the available ones are counted
+bool isHwCounterAvailable(HwCounter counter);
+
+// Opens the counters of the calling thread if counting is enabled. They count until the thread exits
+void openThreadHwCounters();
+
+// Stops or restarts the counters of the calling thread, to leave out work that shouldn't be counted
+void pauseThreadHwCounters();
+void resumeThreadHwCounters();
+
+// Returns the events counted so far by all threads, including the ones that exited. The counts of
+// a phase are the difference of the samples taken before and after it
+HwCounterValues sampleHwCounters();
+
+#endif
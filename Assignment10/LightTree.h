@@ -0,0 +1,206 @@
+#ifndef LIGHTTREE_H
+#define LIGHTTREE_H
+
+#include <algorithm>
+#include <array>
+#include <vector>
+#include "AABBox.h"
+#include "MathUtil.h"
+#include "PointLight.h"
+
+static constexpr uint32_t MAX_LIGHTS_IN_LEAF = 4;
+static constexpr int LIGHT_TREE_STACK_SIZE = 64;
+
+// Node of the light hierarchy. Interior nodes store their first child right after them
+struct LightNode {
+    BBox bounds;             // Bounds of the light positions under the node
+    float maxIntensity = 0;  // Highest intensity of a light under the node
+    float sumIntensity = 0;  // Total intensity of the lights under the node
+    uint32_t offset = 0;     // Index of the first light for leaves, of the second child otherwise
+    uint32_t numLights = 0;  // Number of lights in a leaf, 0 for interior nodes
+
+    bool isLeaf() const { return numLights > 0; }
+};
+
+// Returns the squared distance from point _p_ to the closest point of _box_
+inline static float distanceSquared(const Pointf& p, const BBox& box) {
+    float distSquared = 0.f;
+    for (int i = 0; i < 3; i++) {
+        const float d = std::max({ box.min[i] - p[i], 0.f, p[i] - box.max[i] });
+        distSquared += d * d;
+    }
+    return distSquared;
+}
+
+/// @brief Bounding volume hierarchy over the scene point lights. It finds the lights that
+/// can contribute noticeably at a point without visiting all of them, and picks lights at
+/// random with probability proportional to their estimated contribution.
+class LightTree {
+public:
+    LightTree() = delete;
+
+    explicit LightTree(const std::vector<PointLight>& sceneLights) {
+        if (sceneLights.empty())
+            return;
+
+        std::vector<uint32_t> lightIndices(sceneLights.size());
+        for (uint32_t i = 0; i < lightIndices.size(); i++) {
+            lightIndices[i] = i;
+        }
+        nodes.reserve(2 * sceneLights.size() / MAX_LIGHTS_IN_LEAF + 1);
+        lights.reserve(sceneLights.size());
+        build(sceneLights, lightIndices, 0, uint32_t(lightIndices.size()));
+    }
+
+    // Calls _visit_ for every light that may deliver at least _minIrradiance_ to point _p_.
+    // Nodes are culled by the inverse-square falloff of their strongest light at their closest point
+    template <typename Visitor>
+    void forEachLight(const Pointf& p, const float minIrradiance, Visitor&& visit) const {
+        if (nodes.empty())
+            return;
+
+        std::array<uint32_t, LIGHT_TREE_STACK_SIZE> stack;
+        int stackSize = 0;
+        stack[stackSize++] = 0;
+        while (stackSize > 0) {
+            const uint32_t nodeIdx = stack[--stackSize];
+            const LightNode& node = nodes[nodeIdx];
+            if (node.maxIntensity < minIrradiance * calcSphereArea(sqrtf(distanceSquared(p, node.bounds))))
+                continue;
+
+            if (node.isLeaf()) {
+                for (uint32_t i = node.offset; i < node.offset + node.numLights; i++) {
+                    visit(lights[i]);
+                }
+            }
+            else {
+                Assert(stackSize + 2 <= LIGHT_TREE_STACK_SIZE && "LightTree stack overflow");
+                stack[stackSize++] = node.offset;
+                stack[stackSize++] = nodeIdx + 1;
+            }
+        }
+    }
+
+    // Picks a light at random with probability roughly proportional to its contribution at
+    // point _p_ using the uniform number _u_ in [0, 1). _pdf_ receives the probability of the pick
+    const PointLight* sampleLight(const Pointf& p, float u, float& pdf) const {
+        if (nodes.empty())
+            return nullptr;
+
+        pdf = 1.f;
+        uint32_t nodeIdx = 0;
+        while (!nodes[nodeIdx].isLeaf()) {
+            const uint32_t leftIdx = nodeIdx + 1;
+            const uint32_t rightIdx = nodes[nodeIdx].offset;
+            const float leftImportance = calcImportance(p, nodes[leftIdx]);
+            const float rightImportance = calcImportance(p, nodes[rightIdx]);
+            const float sumImportance = leftImportance + rightImportance;
+            const float leftProb = sumImportance > 0.f ? leftImportance / sumImportance : 0.5f;
+
+            // reuses _u_ for the next decision by rescaling the chosen part back to [0, 1)
+            if (u < leftProb) {
+                nodeIdx = leftIdx;
+                u = std::min(u / leftProb, ONE_MINUS_EPSILON);
+                pdf *= leftProb;
+            }
+            else {
+                nodeIdx = rightIdx;
+                u = std::min((u - leftProb) / (1.f - leftProb), ONE_MINUS_EPSILON);
+                pdf *= 1.f - leftProb;
+            }
+        }
+
+        const LightNode& leaf = nodes[nodeIdx];
+        std::array<float, MAX_LIGHTS_IN_LEAF> importance;
+        float sumImportance = 0.f;
+        for (uint32_t i = 0; i < leaf.numLights; i++) {
+            const PointLight& light = lights[leaf.offset + i];
+            importance[i] = light.getIntensity() /
+                std::max((light.getPosition() - p).lengthSquared(), MIN_LIGHT_DISTANCE_SQUARED);
+            sumImportance += importance[i];
+        }
+
+        // falls back to uniform selection for leaves with lights of zero intensity only
+        if (sumImportance <= 0.f) {
+            std::fill(importance.begin(), importance.end(), 1.f);
+            sumImportance = float(leaf.numLights);
+        }
+
+        uint32_t lightIdx = 0;
+        float cdf = importance[0] / sumImportance;
+        while (u >= cdf && lightIdx + 1 < leaf.numLights) {
+            cdf += importance[++lightIdx] / sumImportance;
+        }
+        pdf *= importance[lightIdx] / sumImportance;
+
+        return &lights[leaf.offset + lightIdx];
+    }
+
+    // Returns the index of a light returned by the tree
+    uint32_t getLightIndex(const PointLight& light) const {
+        Assert(&light >= lights.data() && &light < lights.data() + lights.size());
+        return uint32_t(&light - lights.data());
+    }
+
+    bool empty() const { return lights.empty(); }
+
+private:
+    static constexpr float ONE_MINUS_EPSILON = 0x1.fffffep-1f;
+    static constexpr float MIN_LIGHT_DISTANCE_SQUARED = 1e-4f;
+
+    // Estimates the contribution of the node lights at point _p_. Points closer than the node
+    // extent use the extent instead, so that no light under the node gets zero probability
+    static float calcImportance(const Pointf& p, const LightNode& node) {
+        const CRTVectorf diagonal = node.bounds.max - node.bounds.min;
+        const Pointf center = node.bounds.min + diagonal * 0.5f;
+        const float distSquared = std::max({ (center - p).lengthSquared(),
+            0.25f * diagonal.lengthSquared(), MIN_LIGHT_DISTANCE_SQUARED });
+        return node.sumIntensity / distSquared;
+    }
+
+    // Builds the subtree over _lightIndices_ in [begin, end) splitting at the median
+    // of the widest axis, and returns the index of its root node
+    uint32_t build(const std::vector<PointLight>& sceneLights, std::vector<uint32_t>& lightIndices,
+        const uint32_t begin, const uint32_t end) {
+        const uint32_t nodeIdx = uint32_t(nodes.size());
+        nodes.emplace_back();
+
+        LightNode node;
+        for (uint32_t i = begin; i < end; i++) {
+            const PointLight& light = sceneLights[lightIndices[i]];
+            node.bounds.expandBy(light.getPosition());
+            node.maxIntensity = std::max(node.maxIntensity, float(light.getIntensity()));
+            node.sumIntensity += float(light.getIntensity());
+        }
+
+        if (end - begin <= MAX_LIGHTS_IN_LEAF) {
+            node.offset = uint32_t(lights.size());
+            node.numLights = end - begin;
+            for (uint32_t i = begin; i < end; i++) {
+                lights.push_back(sceneLights[lightIndices[i]]);
+            }
+        }
+        else {
+            const CRTVectorf diagonal = node.bounds.max - node.bounds.min;
+            int axis = diagonal.x > diagonal.y ? 0 : 1;
+            axis = diagonal.z > diagonal[axis] ? 2 : axis;
+
+            const uint32_t mid = begin + (end - begin) / 2;
+            std::nth_element(lightIndices.begin() + begin, lightIndices.begin() + mid,
+                lightIndices.begin() + end, [&](const uint32_t l1, const uint32_t l2) {
+                    return sceneLights[l1].getPosition()[axis] < sceneLights[l2].getPosition()[axis];
+                });
+
+            build(sceneLights, lightIndices, begin, mid);
+            node.offset = build(sceneLights, lightIndices, mid, end);
+        }
+
+        nodes[nodeIdx] = node;
+        return nodeIdx;
+    }
+
+    std::vector<LightNode> nodes;    // Tree nodes in depth-first order
+    std::vector<PointLight> lights;  // Scene lights in the order of the tree leaves
+};
+
+#endif
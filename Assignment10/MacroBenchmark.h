@@ -0,0 +1,262 @@
+#ifndef MACROBENCHMARK_H
+#define MACROBENCHMARK_H
+
+#include <charconv>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "MathUtil.h"
+#include "PPMImage.h"
+#include "RenderStats.h"
+#include "rapidjson/document.h"
+#include "rapidjson/istreamwrapper.h"
+
+// Options of the benchmark mode, which renders every scene on thread pools of different sizes
+struct BenchmarkOptions {
+    bool enabled = false;
+    std::vector<unsigned> threadCounts;  // Pool sizes to render with, 1, 2, 4 ... hardware threads if empty
+    unsigned numRuns = 3;  // Renders of each scene on each pool size, of which the fastest is kept
+    std::string reportFile;    // JSON report to write, none if empty
+    std::string baselineFile;  // Report of an earlier run to compare with, none if empty
+    double tolerance = 0.1;    // Fraction by which a render may be slower than the baseline
+};
+
+// Returns 1, 2, 4 ... up to _maxThreads_, which is always the last count
+inline static std::vector<unsigned> getDefaultThreadCounts(const unsigned maxThreads) {
+    std::vector<unsigned> threadCounts;
+    for (unsigned count = 1; count < maxThreads; count *= 2) {
+        threadCounts.push_back(count);
+    }
+    threadCounts.push_back(maxThreads);
+    return threadCounts;
+}
+
+// Parses a comma separated list of positive thread counts. Returns false if _text_ isn't one
+inline static bool parseThreadCounts(std::string_view text, std::vector<unsigned>& threadCounts) {
+    threadCounts.clear();
+    while (!text.empty()) {
+        const size_t comma = std::min(text.find(','), text.size());
+        unsigned count = 0;
+        const auto [end, error] = std::from_chars(text.data(), text.data() + comma, count);
+        if (error != std::errc() || end != text.data() + comma || count == 0) {
+            return false;
+        }
+        threadCounts.push_back(count);
+        text.remove_prefix(std::min(comma + 1, text.size()));
+    }
+    return !threadCounts.empty();
+}
+
+/// @brief Results of rendering a set of scenes on thread pools of different sizes. Shows how
+/// rendering scales with the threads, and is compared with the report of an earlier run to catch
+/// render time regressions and any change of the rendered images.
+class BenchmarkReport {
+public:
+    // Adds the result of a scene on a pool size
+    void add(const RenderStats& stats) { results.push_back(stats); }
+
+    // Returns how many times faster the render phase of _stats_ is than the one of the same scene
+    // on the fewest threads
+    double getSpeedup(const RenderStats& stats) const {
+        const RenderStats& first = getFewestThreads(stats);
+        const int64_t renderNanoSec = stats.phaseNanoSec[int(Phase::Render)];
+        return renderNanoSec > 0 ? double(first.phaseNanoSec[int(Phase::Render)]) / renderNanoSec : 0.0;
+    }
+
+    // Returns the speedup divided by the times more threads used, 1 when rendering scales linearly
+    double getEfficiency(const RenderStats& stats) const {
+        return getSpeedup(stats) * getFewestThreads(stats).numThreads / stats.numThreads;
+    }
+
+    // Returns false if a scene rendered a different image on some pool size, which is a bug,
+    // since the number of threads must not change the image
+    bool checkImagesMatch(std::ostream& out) const {
+        bool match = true;
+        for (const RenderStats& stats : results) {
+            const RenderStats& first = getFewestThreads(stats);
+            if (stats.imageChecksum != first.imageChecksum) {
+                out << stats.sceneFile << " renders a different image on " << stats.numThreads << " threads than on "
+                    << first.numThreads << "\n";
+                match = false;
+            }
+        }
+        return match;
+    }
+
+    void print(std::ostream& out) const {
+        out << "Benchmark results:\n" << std::left << std::setw(28) << "scene" << std::right << std::setw(8)
+            << "threads" << std::setw(10) << "parse_ms" << std::setw(10) << "build_ms" << std::setw(11)
+            << "render_ms" << std::setw(10) << "write_ms" << std::setw(10) << "peak_MB" << std::setw(9) << "Mrays/s"
+            << std::setw(9) << "speedup" << std::setw(11) << "efficiency" << "  checksum\n";
+        out << std::fixed;
+        for (const RenderStats& stats : results) {
+            out << std::left << std::setw(28) << stats.sceneFile << std::right << std::setw(8) << stats.numThreads
+                << std::setprecision(1);
+            for (int i = 0; i < int(Phase::Count); i++) {
+                out << std::setw(i == int(Phase::Render) ? 11 : 10)
+                    << Timer::toMilliSec<double>(double(stats.phaseNanoSec[i]));
+            }
+            out << std::setw(10) << stats.peakMemoryBytes / (1024.0 * 1024.0) << std::setprecision(2) << std::setw(9)
+                << stats.getRaysPerSec() / 1e6 << std::setw(9) << getSpeedup(stats) << std::setw(11)
+                << getEfficiency(stats) << "  " << formatChecksum(stats.imageChecksum) << "\n";
+        }
+        out.unsetf(std::ios::floatfield);
+        out << std::setprecision(6);
+    }
+
+    // Writes the results as JSON and copies the image of each scene next to _fileName_, so later
+    // runs compared with this report can tell how much their images changed
+    int32_t writeJson(const std::string& fileName) const {
+        std::ofstream out(fileName);
+        if (!out.good()) {
+            std::cerr << "Failed to write " << fileName << " file." << std::endl;
+            return EXIT_FAILURE;
+        }
+        out << "{\n  \"results\": [";
+        for (size_t i = 0; i < results.size(); i++) {
+            const RenderStats& stats = results[i];
+            const std::string imageName = getReportImageName(fileName, stats.sceneFile);
+            out << (i ? ",\n" : "\n") << "    { \"scene\": \"" << stats.sceneFile << "\", \"threads\": "
+                << stats.numThreads << ", \"width\": " << stats.width << ", \"height\": " << stats.height;
+            for (int phase = 0; phase < int(Phase::Count); phase++) {
+                out << ", \"" << getPhaseName(Phase(phase)) << "_ms\": "
+                    << Timer::toMilliSec<double>(double(stats.phaseNanoSec[phase]));
+            }
+            out << ", \"peak_memory_bytes\": " << stats.peakMemoryBytes << ", \"rays_per_sec\": "
+                << stats.getRaysPerSec() << ", \"speedup\": " << getSpeedup(stats) << ", \"efficiency\": "
+                << getEfficiency(stats) << ", \"image_checksum\": \"" << formatChecksum(stats.imageChecksum)
+                << "\", \"image\": \"" << imageName << "\" }";
+
+            if (&getFewestThreads(stats) == &stats &&
+                !copyFile(getPpmFileName(stats.sceneFile), getDirectory(fileName) + imageName)) {
+                std::cerr << "Failed to copy the image of " << stats.sceneFile << " next to " << fileName << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+        out << "\n  ]\n}\n";
+        std::cout << "Benchmark report written to " << fileName << "\n";
+        return EXIT_SUCCESS;
+    }
+
+    // Compares the results with the report in _fileName_, matching them by scene and number of
+    // threads. Returns EXIT_FAILURE if the report can't be read, if an image differs from the one
+    // of the report or if a render got slower than the report by more than _tolerance_
+    int32_t compareBaseline(const std::string& fileName, const double tolerance) const {
+        std::ifstream in(fileName);
+        if (!in.good()) {
+            std::cerr << "Failed to read " << fileName << " file." << std::endl;
+            return EXIT_FAILURE;
+        }
+        rapidjson::BasicIStreamWrapper<std::ifstream> istreamWrapper(in);
+        rapidjson::Document doc;
+        doc.ParseStream(istreamWrapper);
+        if (doc.HasParseError() || !doc.IsObject() || !doc.HasMember("results") ||
+            !doc.FindMember("results")->value.IsArray()) {
+            std::cerr << "Failed to parse " << fileName << " file." << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        const rapidjson::Value& baseline = doc.FindMember("results")->value;
+        int numRegressions = 0, numChangedImages = 0;
+        std::cout << "Compared to " << fileName << ":\n";
+        for (const RenderStats& stats : results) {
+            const rapidjson::Value* baselineResult = nullptr;
+            for (const rapidjson::Value& result : baseline.GetArray()) {
+                if (result.HasMember("scene") && result.HasMember("threads") &&
+                    stats.sceneFile == result.FindMember("scene")->value.GetString() &&
+                    stats.numThreads == result.FindMember("threads")->value.GetUint()) {
+                    baselineResult = &result;
+                }
+            }
+            std::cout << "  " << stats.sceneFile << " on " << stats.numThreads << " threads: ";
+            if (!baselineResult) {
+                std::cout << "not in baseline\n";
+                continue;
+            }
+
+            const double renderMs = Timer::toMilliSec<double>(double(stats.phaseNanoSec[int(Phase::Render)]));
+            const double baselineMs = baselineResult->FindMember("render_ms")->value.GetDouble();
+            const double change = renderMs / baselineMs - 1.0;
+            const bool regression = change > tolerance;
+            numRegressions += regression;
+            std::cout << renderMs << "ms vs " << baselineMs << "ms (" << (change > 0.0 ? "+" : "") << 100.0 * change
+                << "%)" << (regression ? " REGRESSION" : "");
+
+            const std::string baselineChecksum = baselineResult->FindMember("image_checksum")->value.GetString();
+            if (baselineChecksum == formatChecksum(stats.imageChecksum)) {
+                std::cout << ", same image\n";
+                continue;
+            }
+            numChangedImages++;
+            std::cout << ", IMAGE CHANGED";
+            const std::string baselineImage =
+                getDirectory(fileName) + baselineResult->FindMember("image")->value.GetString();
+            const double psnr = computeImagePSNR(getPpmFileName(stats.sceneFile), baselineImage);
+            if (psnr >= 0.0) {
+                std::cout << " (PSNR " << psnr << "dB)\n";
+            }
+            else {
+                std::cout << " (" << baselineImage << " can't be read)\n";
+            }
+        }
+
+        if (numRegressions > 0 || numChangedImages > 0) {
+            std::cerr << numRegressions << " renders are slower than the baseline by more than " << 100.0 * tolerance
+                << "% and " << numChangedImages << " images differ from it" << std::endl;
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
+private:
+    // Returns the result of the scene of _stats_ on the fewest threads
+    const RenderStats& getFewestThreads(const RenderStats& stats) const {
+        const RenderStats* first = &stats;
+        for (const RenderStats& other : results) {
+            if (other.sceneFile == stats.sceneFile && other.numThreads < first->numThreads) {
+                first = &other;
+            }
+        }
+        return *first;
+    }
+
+    // Returns the directory part of _fileName_, including the separator
+    static std::string getDirectory(const std::string& fileName) {
+        const size_t separator = fileName.find_last_of("/\\");
+        return separator == std::string::npos ? std::string() : fileName.substr(0, separator + 1);
+    }
+
+    // Returns the name of the copy of the image of _sceneFile_ kept with the report _reportFile_
+    static std::string getReportImageName(const std::string& reportFile, const std::string& sceneFile) {
+        return getOutputFileName(reportFile, ".") + getPpmFileName(sceneFile);
+    }
+
+    static bool copyFile(const std::string& from, const std::string& to) {
+        std::ifstream in(from, std::ios::in | std::ios::binary);
+        std::ofstream out(to, std::ios::out | std::ios::binary);
+        if (!in.good() || !out.good()) {
+            return false;
+        }
+        out << in.rdbuf();
+        return out.good();
+    }
+
+    // Returns the PSNR of the image in _imageFile_ against the one in _referenceFile_, or -1 if
+    // either can't be read
+    static double computeImagePSNR(const std::string& imageFile, const std::string& referenceFile) {
+        std::ifstream imageIn(imageFile), referenceIn(referenceFile);
+        PPMImageI image(0, 0), reference(0, 0);
+        if (!readPPMImage(imageIn, image) || !readPPMImage(referenceIn, reference)) {
+            return -1.0;
+        }
+        return computePSNR(image, reference);
+    }
+
+    std::vector<RenderStats> results;
+};
+
+#endif
@@ -1,141 +1,170 @@
 #include "Material.h"
 #include "Scene.h"
 
-Colorf Material::shade(const CRTRay& ray, const Scene* scene, InfoIntersect& infoIntersect) const {
-    Colorf shadeColor;
-    const MaterialType& hittedMaterialType = scene->getMaterials()[infoIntersect.materialIdx].type;
-    if (hittedMaterialType == MaterialType::Diffuse) {
-        shadeColor = shadeDiffuse(ray, scene, infoIntersect);
+// Calculates the lighting contribution of a single point light at a diffuse hit point scaled by
+// _lightScale_. If the context has a shadow queue, the shadow ray is queued there together with
+// the contribution weighted by the path _weight_, and no color is returned
+static Colorf shadeLight(const PointLight& light, const Scene* scene, const InfoIntersect& infoIntersect,
+    const Normalf& intersectNormal, const Colorf& albedo, const float lightScale,
+    const Colorf& weight, TraceContext& context) {
+    CRTVectorf lightDir = light.getPosition() - infoIntersect.pos;
+    const float lightDist = lightDir.length();
+    const float lightArea = calcSphereArea(lightDist);
+    const CRTVectorf lightDirN = normalize(lightDir);
+    const float cosTheta = std::max(0.f, dot(lightDirN, intersectNormal));
+    if (cosTheta == 0.f) {
+        // No need of a shadow ray for a light behind the surface
+        return Colorf(0.f);
     }
-    else if (hittedMaterialType == MaterialType::Reflective) {
-        shadeColor = shadeReflective(ray, scene, infoIntersect);
-    }
-    else if (hittedMaterialType == MaterialType::Refractive) {
-        shadeColor = shadeRefractive(ray, scene, infoIntersect);
-    }
-    else if (hittedMaterialType == MaterialType::Constant) {
-        shadeColor = shadeConstant(ray, scene, infoIntersect);
+
+    const CRTRay shadowRay(infoIntersect.pos + intersectNormal * SHADOW_BIAS, lightDirN);
+    shadowRay.tMax = lightDist;
+    CRT_COUNT(ShadowRays, 1);
+    const Colorf lightColor = Colorf(light.getIntensity() / lightArea * albedo * cosTheta) * lightScale;
+    if (context.shadowQueue) {
+        context.shadowQueue->push_back(ShadowQuery{ shadowRay, weight * lightColor,
+            scene->getLightTree().getLightIndex(light), context.pixelIdx });
+        return Colorf(0.f);
     }
-    else {
-        Assert(false && "Material:: unsupported material type.");
+
+    if (scene->intersectPrim(shadowRay)) {
+        // The shadow ray is occluded by an object in the scene
+        return Colorf(0.f);
     }
-    return shadeColor;
+    return lightColor;
 }
 
-Colorf shadeDiffuse([[maybe_unused]] const CRTRay& ray, const Scene* scene, InfoIntersect& infoIntersect) {
+// Shades a hit on the material in slot _slot_ of the _type_ material table
+template <MaterialType type>
+static Colorf shadeMaterial(const CRTRay& ray, const Scene* scene, const InfoIntersect& infoIntersect,
+    uint32_t slot, const Colorf& weight, TraceContext& context);
+
+template <>
+Colorf shadeMaterial<MaterialType::Diffuse>([[maybe_unused]] const CRTRay& ray, const Scene* scene,
+    const InfoIntersect& infoIntersect, const uint32_t slot, const Colorf& weight, TraceContext& context) {
     // Calculates the diffuse shading for a hit point with a diffuse material
     Colorf hitColor;
-    const std::vector<PointLight>& lights = scene->getLights();
-    const Colorf& albedo = scene->getMaterials()[infoIntersect.materialIdx].property.albedo;
-    bool smoothShading = scene->getMaterials()[infoIntersect.materialIdx].smoothShading;
+    const LightTree& lightTree = scene->getLightTree();
+    const LightSampling& lightSampling = context.settings.lightSampling;
+    const MaterialTable& materials = scene->getMaterialTable();
+    const Colorf& albedo = materials.getAlbedo<MaterialType::Diffuse>(slot);
+    const bool smoothShading = materials.isSmooth<MaterialType::Diffuse>(slot);
     const Normalf intersectNormal = smoothShading ? infoIntersect.smoothNormal : infoIntersect.faceNormal;
-    for (const PointLight& light : lights) {
-        // Calculate the lighting contribution from each point light
-        CRTVectorf lightDir = light.getPosition() - infoIntersect.pos;
-        const float lightDist = lightDir.length();
-        const float lightArea = calcSphereArea(lightDist);
-        const CRTVectorf lightDirN = normalize(lightDir);
-        const float cosTheta = std::max(0.f, dot(lightDirN, intersectNormal));
-        const CRTRay shadowRay(infoIntersect.pos + intersectNormal * SHADOW_BIAS, lightDirN);
-        shadowRay.tMax = lightDist;
-        Colorf perLightColor;
-        if (!scene->intersectPrim(shadowRay)) {
-            // Check if the shadow ray is occluded by any objects in the scene
-            perLightColor = Colorf(light.getIntensity() / lightArea * albedo * cosTheta);
+
+    if (lightSampling.numSamples > 0 && size_t(lightSampling.numSamples) < scene->getLights().size()) {
+        // Estimates the lighting from a few lights picked at random, each one weighted by the
+        // inverse probability of being picked
+        for (int i = 0; i < lightSampling.numSamples; i++) {
+            float lightPdf = 0.f;
+            const PointLight* light =
+                lightTree.sampleLight(infoIntersect.pos, context.rng.uniformFloat(), lightPdf);
+            hitColor += shadeLight(*light, scene, infoIntersect, intersectNormal, albedo,
+                1.f / (lightPdf * lightSampling.numSamples), weight, context);
         }
-        hitColor += perLightColor;
+        return hitColor;
     }
 
+    // Skips the lights that can't deliver _minContribution_ to the pixel color through the
+    // albedo and the weight of the ray path
+    const float maxReflectance =
+        std::max({ weight.x * albedo.x, weight.y * albedo.y, weight.z * albedo.z });
+    if (maxReflectance <= 0.f) {
+        return hitColor;
+    }
+    const float minIrradiance = lightSampling.minContribution / maxReflectance;
+    lightTree.forEachLight(infoIntersect.pos, minIrradiance, [&](const PointLight& light) {
+        hitColor += shadeLight(light, scene, infoIntersect, intersectNormal, albedo, 1.f, weight, context);
+    });
+
     return hitColor;
 }
 
-Colorf shadeReflective(const CRTRay& ray, const Scene* scene, InfoIntersect& infoIntersect) {
+template <>
+Colorf shadeMaterial<MaterialType::Reflective>(const CRTRay& ray, const Scene* scene,
+    const InfoIntersect& infoIntersect, const uint32_t slot, const Colorf& weight, TraceContext& context) {
     // Calculates the shading for a hit point with a reflective material
-    bool smoothShading = scene->getMaterials()[infoIntersect.materialIdx].smoothShading;
+    const MaterialTable& materials = scene->getMaterialTable();
+    const Colorf& albedo = materials.getAlbedo<MaterialType::Reflective>(slot);
+    if (ray.depth > context.settings.maxRayDepth) {
+        return albedo * scene->getBackground();
+    }
+
+    const bool smoothShading = materials.isSmooth<MaterialType::Reflective>(slot);
     Normalf surfNormal = smoothShading ? infoIntersect.smoothNormal : infoIntersect.faceNormal;
     const CRTVectorf reflectedDir = reflect(ray.dir, surfNormal);
     CRTRay reflectedRay = CRTRay(infoIntersect.pos + surfNormal * REFLECTION_BIAS, reflectedDir);
-    const Colorf& albedo = scene->getMaterials()[infoIntersect.materialIdx].property.albedo;
-    if (ray.depth <= MAX_RAY_DEPTH && scene->intersect(reflectedRay, infoIntersect)) {
-        const Material* hittedMaterial = &scene->getMaterials()[infoIntersect.materialIdx];
-        if (hittedMaterial->type == MaterialType::Reflective) {
-            reflectedRay.depth = ray.depth + 1;
-            return hittedMaterial->shade(reflectedRay, scene, infoIntersect);
-        }
-        else {
-            return albedo * hittedMaterial->shade(reflectedRay, scene, infoIntersect);
-        }
-    }
-    return albedo * scene->getBackground();
+    reflectedRay.depth = ray.depth + 1;
+    CRT_COUNT(ReflectionRays, 1);
+    CRT_COUNT_RAY_DEPTH(reflectedRay.depth);
+    context.rayStack.push(reflectedRay, weight * albedo);
+    return Colorf(0.f);
 }
 
-Colorf shadeRefractive(const CRTRay& ray, const Scene* scene, InfoIntersect& infoIntersect) {
+template <>
+Colorf shadeMaterial<MaterialType::Refractive>(const CRTRay& ray, const Scene* scene,
+    const InfoIntersect& infoIntersect, const uint32_t slot, const Colorf& weight, TraceContext& context) {
     // Calculates the shading for a hit point with a refractive material
-    if (ray.depth <= MAX_RAY_DEPTH) {
-        bool smoothShading = scene->getMaterials()[infoIntersect.materialIdx].smoothShading;
-        Normalf surfNormal = smoothShading ? infoIntersect.smoothNormal : infoIntersect.faceNormal;
-        float cosThetaI = clamp(-1.f, 1.f, dot(ray.dir, surfNormal));
-        const float ior = scene->getMaterials()[infoIntersect.materialIdx].property.ior;
-        float etaI = 1.f, etaT = ior;
-        bool rayLeaveTransparent = cosThetaI > 0.f;
-        if (rayLeaveTransparent) {
-            std::swap(etaI, etaT);
-            surfNormal = -surfNormal;
-        }
-        else
-            cosThetaI = -cosThetaI;
-
-        Colorf refractColor, reflectColor;
-        CRTVectorf refrRayDir;
-        if (refract(ray.dir, surfNormal, etaI / etaT, cosThetaI, &refrRayDir)) {
-            // construct and trace refraction ray in the scene
-            CRTRay refractionRay = CRTRay(infoIntersect.pos + (-surfNormal * REFRACTION_BIAS), refrRayDir);
-            InfoIntersect refrInfoIntersect;
-            if (scene->intersect(refractionRay, refrInfoIntersect)) {
-                refractionRay.depth = ray.depth + 1;
-                const Material* hittedMaterial = &scene->getMaterials()[refrInfoIntersect.materialIdx];
-                refractColor = hittedMaterial->shade(refractionRay, scene, refrInfoIntersect);
-            }
-            else {
-                refractColor = scene->getBackground();
-            }
-
-            // construct and trace reflection ray in the scene
-            const CRTVectorf reflRayDir = reflect(ray.dir, surfNormal);
-            CRTRay reflectionRay = CRTRay(infoIntersect.pos + (surfNormal * REFLECTION_BIAS), reflRayDir);
-            InfoIntersect reflInfoIntersect;
-            if (scene->intersect(reflectionRay, reflInfoIntersect)) {
-                reflectionRay.depth = ray.depth + 1;
-                const Material* hittedMaterial = &scene->getMaterials()[reflInfoIntersect.materialIdx];
-                reflectColor = hittedMaterial->shade(reflectionRay, scene, reflInfoIntersect);
-            }
-            else {
-                reflectColor = scene->getBackground();
-            }
-
-            const float fres = fresnel(ray.dir, surfNormal);
-            return fres * reflectColor + (1 - fres) * refractColor;
-        }
-        else {
-            const CRTVectorf reflRayDir = reflect(ray.dir, surfNormal);
-            CRTRay reflectionRay = CRTRay(infoIntersect.pos + (surfNormal * REFLECTION_BIAS), reflRayDir);
-            InfoIntersect reflInfoIntersect;
-            if (scene->intersect(reflectionRay, reflInfoIntersect)) {
-                reflectionRay.depth = ray.depth + 1;
-                const Material* hittedMaterial = &scene->getMaterials()[reflInfoIntersect.materialIdx];
-                return hittedMaterial->shade(reflectionRay, scene, reflInfoIntersect);
-            }
-            else {
-                return scene->getBackground();
-            }
-        }
+    if (ray.depth > context.settings.maxRayDepth) {
+        return scene->getBackground();
+    }
+
+    const MaterialTable& materials = scene->getMaterialTable();
+    const bool smoothShading = materials.isSmooth<MaterialType::Refractive>(slot);
+    Normalf surfNormal = smoothShading ? infoIntersect.smoothNormal : infoIntersect.faceNormal;
+    float cosThetaI = clamp(-1.f, 1.f, dot(ray.dir, surfNormal));
+    const float ior = materials.getIor(slot);
+    float etaI = 1.f, etaT = ior;
+    bool rayLeaveTransparent = cosThetaI > 0.f;
+    if (rayLeaveTransparent) {
+        std::swap(etaI, etaT);
+        surfNormal = -surfNormal;
     }
+    else
+        cosThetaI = -cosThetaI;
+
+    // construct reflection ray, it carries all of the energy on total internal reflection
+    const CRTVectorf reflRayDir = reflect(ray.dir, surfNormal);
+    CRTRay reflectionRay = CRTRay(infoIntersect.pos + (surfNormal * REFLECTION_BIAS), reflRayDir);
+    reflectionRay.depth = ray.depth + 1;
+    CRT_COUNT(ReflectionRays, 1);
+    CRT_COUNT_RAY_DEPTH(reflectionRay.depth);
 
-    return scene->getBackground();
+    CRTVectorf refrRayDir;
+    if (refract(ray.dir, surfNormal, etaI / etaT, cosThetaI, &refrRayDir)) {
+        // construct refraction ray and split the energy between both rays
+        CRTRay refractionRay = CRTRay(infoIntersect.pos + (-surfNormal * REFRACTION_BIAS), refrRayDir);
+        refractionRay.depth = ray.depth + 1;
+        CRT_COUNT(RefractionRays, 1);
+
+        const float fres = fresnel(ray.dir, surfNormal);
+        context.rayStack.push(refractionRay, weight * (1 - fres));
+        context.rayStack.push(reflectionRay, weight * fres);
+    }
+    else {
+        context.rayStack.push(reflectionRay, weight);
+    }
+
+    return Colorf(0.f);
 }
 
-Colorf shadeConstant([[maybe_unused]] const CRTRay& ray, const Scene* scene,
-    InfoIntersect& infoIntersect) {
+template <>
+Colorf shadeMaterial<MaterialType::Constant>([[maybe_unused]] const CRTRay& ray, const Scene* scene,
+    [[maybe_unused]] const InfoIntersect& infoIntersect, const uint32_t slot,
+    [[maybe_unused]] const Colorf& weight, [[maybe_unused]] TraceContext& context) {
     // Calculates the shading for a hit point with a constant material
-    return scene->getMaterials()[infoIntersect.materialIdx].property.albedo;
+    return scene->getMaterialTable().getAlbedo<MaterialType::Constant>(slot);
+}
+
+using ShadeFunction = Colorf (*)(const CRTRay&, const Scene*, const InfoIntersect&, uint32_t, const Colorf&,
+    TraceContext&);
+
+// Shading kernel of each material type, indexed by MaterialType
+static constexpr ShadeFunction shadeFunctions[NUM_MATERIAL_TYPES] = {
+    &shadeMaterial<MaterialType::Diffuse>, &shadeMaterial<MaterialType::Reflective>,
+    &shadeMaterial<MaterialType::Refractive>, &shadeMaterial<MaterialType::Constant> };
+
+Colorf shade(const CRTRay& ray, const Scene* scene, const InfoIntersect& infoIntersect,
+    const Colorf& weight, TraceContext& context) {
+    const MaterialRef& materialRef = scene->getMaterialTable().getRef(infoIntersect.materialIdx);
+    return shadeFunctions[int(materialRef.type)](ray, scene, infoIntersect, materialRef.slot, weight, context);
 }
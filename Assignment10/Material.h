@@ -2,18 +2,114 @@
 #define MATERIAL_H
 
 #include "CRTTriangle.h"
+#include "Random.h"
+#include <algorithm>
+#include <array>
 #include <string>
+#include <vector>
 
 struct Scene;
 
 enum class MaterialType : uint8_t { Diffuse, Reflective, Refractive, Constant, Undefined};
 
+static constexpr int NUM_MATERIAL_TYPES = int(MaterialType::Undefined);
+
 union MaterialProperty {
     Colorf albedo = Colorf(0);
     float ior;
 };
 
 
+// Secondary ray waiting to be traced and the weight of its color in the final pixel color
+struct WeightedRay {
+    CRTRay ray;
+    Colorf weight;
+};
+
+// Controls which secondary rays are not worth tracing
+struct RayPruning {
+    float minWeight = 0.f;  // Rays with all weight components below it are pruned, 0 prunes none
+    bool russianRoulette = false;  // Keeps pruned rays at random and scales up the weight of the survivors
+};
+
+// Fixed-size stack of the secondary rays spawned while tracing a single pixel. Each traced
+// ray pushes at most two children and rays deeper than MAX_RAY_DEPTH push none, so the
+// depth-first evaluation never needs more than RAY_STACK_SIZE slots
+class RayStack {
+public:
+    RayStack(const RayPruning& _pruning, RNG& _rng) : pruning(_pruning), rng(_rng) {}
+
+    // Pushes the ray unless its weight is below the pruning threshold. With russian roulette
+    // such a ray survives with probability proportional to its weight instead, and its weight
+    // is divided by that probability so the expected pixel color stays the same
+    void push(const CRTRay& ray, Colorf weight) {
+        const float maxWeight = std::max({ weight.x, weight.y, weight.z });
+        if (maxWeight < pruning.minWeight) {
+            if (!pruning.russianRoulette)
+                return;
+            const float survivalProb = maxWeight / pruning.minWeight;
+            if (rng.uniformFloat() >= survivalProb)
+                return;
+            weight /= survivalProb;
+        }
+
+        Assert(size < rays.size() && "RayStack overflow");
+        rays[size++] = WeightedRay{ ray, weight };
+    }
+
+    WeightedRay pop() {
+        Assert(size > 0 && "RayStack underflow");
+        return rays[--size];
+    }
+
+    bool empty() const { return size == 0; }
+
+private:
+    std::array<WeightedRay, RAY_STACK_SIZE> rays;
+    size_t size = 0;
+    const RayPruning& pruning;
+    RNG& rng;
+};
+
+// Controls which lights are gathered at diffuse hit points
+struct LightSampling {
+    float minContribution = 0.f;  // Lights that can't add more to the pixel are culled, 0 culls none
+    int numSamples = 0;  // When positive, only that many lights are picked at random per hit point
+};
+
+// Settings for tracing rays through the scene
+struct TraceSettings {
+    RayPruning rayPruning;
+    LightSampling lightSampling;
+    int maxRayDepth = MAX_RAY_DEPTH;  // Rays deeper aren't reflected or refracted, at most MAX_RAY_DEPTH, -1 for none
+};
+
+// Shadow ray whose light contribution is added to a pixel only if nothing occludes it
+struct ShadowQuery {
+    CRTRay ray;           // Ray from the hit point towards the light that ends at the light
+    Colorf contribution;  // Light color reaching the pixel, already scaled by the path weight
+    uint32_t lightIdx;    // Index of the light in the scene light tree
+    uint32_t pixelIdx;    // Index of the pixel in the tile being rendered
+};
+
+using ShadowQueue = std::vector<ShadowQuery>;
+
+// Tracing state of a single pixel that is passed to the shading functions
+struct TraceContext {
+    TraceContext(const TraceSettings& _settings, const uint64_t seed)
+        : settings(_settings), rng(seed), rayStack(_settings.rayPruning, rng) {}
+
+    TraceContext(const TraceContext&) = delete;
+    TraceContext& operator=(const TraceContext&) = delete;
+
+    const TraceSettings& settings;
+    RNG rng;             // Random numbers for russian roulette and light sampling
+    RayStack rayStack;   // Secondary rays waiting to be traced
+    ShadowQueue* shadowQueue = nullptr;  // When set, shadow rays are queued here instead of traced
+    uint32_t pixelIdx = 0;               // Pixel that queued shadow rays contribute to
+};
+
+// Material as read from the scene file. Rendering uses the MaterialTable built from these
 struct Material {
     const MaterialProperty property;
     bool smoothShading = false;
@@ -21,38 +117,90 @@ struct Material {
 
     Material(const MaterialProperty& _property, bool _smoothShading, const MaterialType _type)
         : property(_property), smoothShading(_smoothShading), type(_type) {}
+};
 
-    Colorf shade(const CRTRay& ray, const Scene* scene, InfoIntersect& infoIntersect) const;
+// Location of a scene material in the MaterialTable
+struct MaterialRef {
+    MaterialType type;
+    uint32_t slot;  // Index of the material among the materials of its type
 };
 
-inline static Material makeMaterial(std::string_view materialType, const MaterialProperty& property,
-    bool smoothShading) {
-    MaterialType mtype = MaterialType::Undefined;
-    if (materialType == "diffuse") {
-        mtype = MaterialType::Diffuse;
+// Scene materials sorted by type into structure of arrays tables. The union property of each
+// material is resolved to the field its type uses once at load, so shading a hit reads only
+// that field from a table of materials of the same type
+class MaterialTable {
+public:
+    MaterialTable() = delete;
+
+    explicit MaterialTable(const std::vector<Material>& materials) {
+        refs.reserve(materials.size());
+        for (const Material& material : materials) {
+            Assert(material.type != MaterialType::Undefined && "MaterialTable received undefined material type.");
+            TypeTable& table = tables[int(material.type)];
+            refs.push_back(MaterialRef{ material.type, uint32_t(table.smoothShading.size()) });
+            if (material.type == MaterialType::Refractive) {
+                table.ior.push_back(material.property.ior);
+            }
+            else {
+                table.albedo.push_back(material.property.albedo);
+            }
+            table.smoothShading.push_back(material.smoothShading);
+        }
     }
-    else if (materialType == "reflective") {
-        mtype = MaterialType::Reflective;
+
+    const MaterialRef& getRef(const int32_t materialIdx) const { return refs[materialIdx]; }
+
+    template <MaterialType type>
+    const Colorf& getAlbedo(const uint32_t slot) const {
+        static_assert(type != MaterialType::Refractive, "Refractive materials have no albedo");
+        return tables[int(type)].albedo[slot];
     }
-    else if (materialType == "refractive") {
-        mtype = MaterialType::Refractive;
+
+    float getIor(const uint32_t slot) const { return tables[int(MaterialType::Refractive)].ior[slot]; }
+
+    template <MaterialType type>
+    bool isSmooth(const uint32_t slot) const { return tables[int(type)].smoothShading[slot]; }
+
+private:
+    struct TypeTable {
+        std::vector<Colorf> albedo;         // Diffuse, reflective and constant materials only
+        std::vector<float> ior;             // Refractive materials only
+        std::vector<uint8_t> smoothShading;
+    };
+
+    std::array<TypeTable, NUM_MATERIAL_TYPES> tables;
+    std::vector<MaterialRef> refs;  // Table location of each scene material, by material index
+};
+
+// Returns the material type named _materialType_ in scene files, Undefined for unsupported names
+inline static MaterialType getMaterialType(std::string_view materialType) {
+    if (materialType == "diffuse") {
+        return MaterialType::Diffuse;
     }
-    else if (materialType == "constant") {
-        mtype = MaterialType::Constant;
+    if (materialType == "reflective") {
+        return MaterialType::Reflective;
     }
-    else {
-        Assert(mtype != MaterialType::Undefined &&
-            "makeMaterial() recieved unsupported material type.");
+    if (materialType == "refractive") {
+        return MaterialType::Refractive;
     }
-    return Material(property, smoothShading, mtype);
+    if (materialType == "constant") {
+        return MaterialType::Constant;
+    }
+    return MaterialType::Undefined;
 }
 
-Colorf shadeDiffuse(const CRTRay& ray, const Scene* scene, InfoIntersect& infoIntersect);
-
-Colorf shadeReflective(const CRTRay& ray, const Scene* scene, InfoIntersect& infoIntersect);
-
-Colorf shadeRefractive(const CRTRay& ray, const Scene* scene, InfoIntersect& infoIntersect);
+inline static Material makeMaterial(std::string_view materialType, const MaterialProperty& property,
+    bool smoothShading) {
+    const MaterialType mtype = getMaterialType(materialType);
+    Assert(mtype != MaterialType::Undefined &&
+        "makeMaterial() recieved unsupported material type.");
+    return Material(property, smoothShading, mtype);
+}
 
-Colorf shadeConstant(const CRTRay& ray, const Scene* scene, InfoIntersect& infoIntersect);
+// Computes the color emitted at the hit point towards the ray origin. Secondary rays are not
+// traced here but pushed to the context ray stack with their weight scaled by _weight_.
+// The hit is shaded by the kernel of its material type, picked from a jump table
+Colorf shade(const CRTRay& ray, const Scene* scene, const InfoIntersect& infoIntersect,
+    const Colorf& weight, TraceContext& context);
 
 #endif  
\ No newline at end of file
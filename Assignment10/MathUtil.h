@@ -1,3 +1,6 @@
+#ifndef MATHUTIL_H
+#define MATHUTIL_H
+
 #include <iostream>
 #include <thread>
 #include "CRTTriangle.h"
@@ -5,9 +8,9 @@
 
 // Function to calculate the surface normal of a triangle
 inline static Normalf calcSurfaceNormal(const Triangle& triangle) {
-    const CRTVectorf& A = triangle.mesh->vertPositions[triangle.indices[0]];
-    const CRTVectorf& B = triangle.mesh->vertPositions[triangle.indices[1]];
-    const CRTVectorf& C = triangle.mesh->vertPositions[triangle.indices[2]];
+    const CRTVectorf& A = triangle.mesh->geometry->vertPositions[triangle.indices[0]];
+    const CRTVectorf& B = triangle.mesh->geometry->vertPositions[triangle.indices[1]];
+    const CRTVectorf& C = triangle.mesh->geometry->vertPositions[triangle.indices[2]];
     const CRTVectorf E0 = B - A;
     const CRTVectorf E1 = C - A;
     return Normalf(cross(E0, E1).normalize());
@@ -63,11 +66,18 @@ inline static unsigned getHardwareThreads() {
     return std::max<unsigned>(std::thread::hardware_concurrency() - 1, 1);
 }
 
-// Function to generate the PPM file name from the input file name
-inline static std::string getPpmFileName(const std::string& inputFile) {
+// Generates the name of an output file from the input file name and the output _extension_
+inline static std::string getOutputFileName(const std::string& inputFile, const std::string& extension) {
     const size_t start = inputFile.rfind("/");
     const size_t end = inputFile.rfind(".");
     if (start > end)
-        return inputFile.substr(0, end) + ".ppm";
-    return inputFile.substr(start + 1, end - start - 1) + ".ppm";
+        return inputFile.substr(0, end) + extension;
+    return inputFile.substr(start + 1, end - start - 1) + extension;
+}
+
+// Function to generate the PPM file name from the input file name
+inline static std::string getPpmFileName(const std::string& inputFile) {
+    return getOutputFileName(inputFile, ".ppm");
 }
+
+#endif
@@ -0,0 +1,214 @@
+#ifndef MESHDEDUP_H
+#define MESHDEDUP_H
+
+#include <cstring>
+#include <unordered_map>
+#include "CRTTriangle.h"
+
+// Records how much geometry was removed while importing the scene objects
+struct MeshDedupStats {
+    size_t weldedVertices = 0;       // Vertices merged into an equal (or epsilon-equal) vertex
+    size_t seamVertices = 0;         // Vertices kept apart from an equal one to keep a hard edge
+    size_t degenerateTriangles = 0;  // Triangles dropped because welding collapsed them
+    size_t sharedMeshes = 0;         // Objects that reuse the geometry of a previous object
+    size_t bytesBefore = 0;          // Geometry memory the objects would use without deduplication
+    size_t bytesAfter = 0;           // Geometry memory the objects actually use
+
+    size_t savedBytes() const { return bytesBefore - bytesAfter; }
+};
+
+// Returns the number of bytes used by a mesh geometry with the given vertex & triangle count
+inline static size_t calcGeometryMemory(const size_t numVertices, const size_t numTriangles) {
+    return numVertices * (sizeof(Pointf) + sizeof(Normalf)) + numTriangles * sizeof(TriangleIndices);
+}
+
+// Integer cell coordinates in the spatial hash used for vertex welding
+struct WeldCell {
+    int64_t x, y, z;
+
+    bool operator==(const WeldCell& other) const {
+        return x == other.x && y == other.y && z == other.z;
+    }
+};
+
+struct WeldCellHash {
+    size_t operator()(const WeldCell& cell) const {
+        return size_t(cell.x * 73856093) ^ size_t(cell.y * 19349663) ^ size_t(cell.z * 83492791);
+    }
+};
+
+// Finds the spatial hash cell of point _p_. With zero _epsilon_ the cell is the exact bit
+// pattern of the point, so that only identical vertices end up in the same cell
+inline static WeldCell getWeldCell(const Pointf& p, const float epsilon) {
+    if (epsilon > 0.f) {
+        return WeldCell{ int64_t(floorf(p.x / epsilon)), int64_t(floorf(p.y / epsilon)),
+            int64_t(floorf(p.z / epsilon)) };
+    }
+
+    // adding zero turns -0 into +0 so both have the same bit pattern
+    const float coords[3] = { p.x + 0.f, p.y + 0.f, p.z + 0.f };
+    uint32_t bits[3];
+    std::memcpy(bits, coords, sizeof(bits));
+    return WeldCell{ bits[0], bits[1], bits[2] };
+}
+
+// Returns true if the smoothed vertex normals _n1_ and _n2_, sums of face normals that aren't
+// normalized yet, point the same way, so that welding their vertices wouldn't change them. A zero
+// sum has no direction and takes the one of the other vertex
+inline static bool haveSameNormal(const Normalf& n1, const Normalf& n2) {
+    const float length1 = n1.length();
+    const float length2 = n2.length();
+    return length1 == 0.f || length2 == 0.f || dot(n1, n2) >= WELD_NORMAL_COS * length1 * length2;
+}
+
+// Merges the vertices of a mesh that are closer than _epsilon_ to each other (or exactly equal
+// when _epsilon_ is 0) and drops the triangles that collapse as a result. Vertices split on
+// purpose along a hard edge have different smoothed normals and are kept apart, so that smooth
+// shading doesn't blend the faces on both sides of the edge
+inline static void weldVertices(std::vector<Pointf>& vertPositions,
+    std::vector<TriangleIndices>& vertIndices, const float epsilon, MeshDedupStats& stats) {
+    // sums the face normals of each vertex as MeshGeometry does for its smoothed normals
+    std::vector<Normalf> vertNormals(vertPositions.size());
+    for (const TriangleIndices& indices : vertIndices) {
+        const Pointf& A = vertPositions[indices[0]];
+        const Normalf faceNormal = cross(vertPositions[indices[1]] - A, vertPositions[indices[2]] - A);
+        for (const int vertIdx : indices) {
+            vertNormals[vertIdx] += faceNormal;
+        }
+    }
+
+    std::unordered_map<WeldCell, std::vector<int>, WeldCellHash> cells;
+    cells.reserve(vertPositions.size());
+    std::vector<Pointf> weldedPositions;
+    std::vector<Normalf> weldedNormals;
+    weldedPositions.reserve(vertPositions.size());
+    weldedNormals.reserve(vertPositions.size());
+    std::vector<int> newVertIdx(vertPositions.size());
+    const int searchRadius = epsilon > 0.f ? 1 : 0;
+    const float epsilonSquared = epsilon * epsilon;
+
+    for (size_t i = 0; i < vertPositions.size(); i++) {
+        const Pointf& p = vertPositions[i];
+        const Normalf& normal = vertNormals[i];
+        const WeldCell cell = getWeldCell(p, epsilon);
+
+        // searches the vertex cell and its neighbours for an already kept vertex close to _p_
+        // that shares its smoothed normal
+        int weldIdx = -1;
+        bool isSeam = false;
+        for (int dx = -searchRadius; dx <= searchRadius && weldIdx < 0; dx++) {
+            for (int dy = -searchRadius; dy <= searchRadius && weldIdx < 0; dy++) {
+                for (int dz = -searchRadius; dz <= searchRadius && weldIdx < 0; dz++) {
+                    const auto it = cells.find(WeldCell{ cell.x + dx, cell.y + dy, cell.z + dz });
+                    if (it == cells.end())
+                        continue;
+                    for (const int candidateIdx : it->second) {
+                        if ((weldedPositions[candidateIdx] - p).lengthSquared() > epsilonSquared)
+                            continue;
+                        if (!haveSameNormal(weldedNormals[candidateIdx], normal)) {
+                            isSeam = true;
+                            continue;
+                        }
+                        weldIdx = candidateIdx;
+                        break;
+                    }
+                }
+            }
+        }
+
+        if (weldIdx < 0) {
+            weldIdx = int(weldedPositions.size());
+            weldedPositions.push_back(p);
+            weldedNormals.push_back(normal);
+            cells[cell].push_back(weldIdx);
+            stats.seamVertices += isSeam;
+        }
+        else {
+            weldedNormals[weldIdx] += normal;
+        }
+        newVertIdx[i] = weldIdx;
+    }
+
+    stats.weldedVertices += vertPositions.size() - weldedPositions.size();
+    if (weldedPositions.size() == vertPositions.size())
+        return;
+
+    // remaps the triangle indices and drops the triangles collapsed by the welding
+    std::vector<TriangleIndices> weldedIndices;
+    weldedIndices.reserve(vertIndices.size());
+    for (const TriangleIndices& indices : vertIndices) {
+        const TriangleIndices welded{ newVertIdx[indices[0]], newVertIdx[indices[1]],
+            newVertIdx[indices[2]] };
+        const bool wasDegenerate =
+            indices[0] == indices[1] || indices[1] == indices[2] || indices[0] == indices[2];
+        const bool isDegenerate =
+            welded[0] == welded[1] || welded[1] == welded[2] || welded[0] == welded[2];
+        if (isDegenerate && !wasDegenerate) {
+            stats.degenerateTriangles++;
+            continue;
+        }
+        weldedIndices.push_back(welded);
+    }
+
+    vertPositions = std::move(weldedPositions);
+    vertIndices = std::move(weldedIndices);
+}
+
+// Keeps the geometry of already imported objects, so that objects with identical
+// vertices and triangles share a single MeshGeometry instance
+class MeshGeometryCache {
+public:
+    // Returns geometry built from the given vertices and triangles, or an identical one
+    // that was created earlier. The buffers are looked up as given, so a shared geometry
+    // skips the reordering and the normals of building a MeshGeometry
+    std::shared_ptr<const MeshGeometry> getOrCreate(std::vector<Pointf> vertPositions,
+        std::vector<TriangleIndices> vertIndices, MeshDedupStats& stats) {
+        const size_t hash = hashGeometry(vertPositions, vertIndices);
+        const auto range = geometries.equal_range(hash);
+        for (auto it = range.first; it != range.second; ++it) {
+            const CachedGeometry& cached = it->second;
+            if (cached.vertPositions == vertPositions && cached.vertIndices == vertIndices) {
+                stats.sharedMeshes++;
+                return cached.geometry;
+            }
+        }
+
+        auto geometry = std::make_shared<const MeshGeometry>(vertPositions, vertIndices);
+        stats.bytesAfter += geometry->memoryUsage();
+        geometries.emplace(hash, CachedGeometry{ std::move(vertPositions), std::move(vertIndices), geometry });
+        return geometry;
+    }
+
+private:
+    // Geometry built from the buffers given to getOrCreate, which MeshGeometry reorders
+    struct CachedGeometry {
+        std::vector<Pointf> vertPositions;
+        std::vector<TriangleIndices> vertIndices;
+        std::shared_ptr<const MeshGeometry> geometry;
+    };
+
+    // Hashes the vertex components and triangle indices of a geometry (FNV-1a)
+    static size_t hashGeometry(const std::vector<Pointf>& vertPositions,
+        const std::vector<TriangleIndices>& vertIndices) {
+        uint64_t hash = 14695981039346656037ull;
+        const auto hashBytes = [&hash](const void* data, const size_t size) {
+            const unsigned char* bytes = static_cast<const unsigned char*>(data);
+            for (size_t i = 0; i < size; i++) {
+                hash = (hash ^ bytes[i]) * 1099511628211ull;
+            }
+        };
+
+        // hashes only the x, y, z components since the padding of CRTVector is not initialized
+        for (const Pointf& p : vertPositions) {
+            hashBytes(p.v3, sizeof(p.v3));
+        }
+        hashBytes(vertIndices.data(), vertIndices.size() * sizeof(TriangleIndices));
+        return size_t(hash);
+    }
+
+    // The cache lives only while the objects of a scene are parsed, so keeping the buffers costs
+    // no memory while rendering
+    std::unordered_multimap<size_t, CachedGeometry> geometries;
+};
+
+#endif
@@ -1,8 +1,11 @@
 #ifndef PPMIMAGE_H
 #define PPMIMAGE_H
 
+#include <cmath>
 #include <cstdint>
 #include <iostream>
+#include <limits>
+#include <string>
 #include <vector>
 #include "CRTVector.h"
 
@@ -22,8 +25,11 @@ struct PPMImage {
     PPMImage() = delete;
 
     // Constructor that takes the image width and height
-    PPMImage(const int imageWidth, const int imageHeight) : data(imageWidth* imageHeight) {}
+    PPMImage(const int imageWidth, const int imageHeight)
+        : width(imageWidth), height(imageHeight), data(imageWidth* imageHeight) {}
 
+    int width;   // Image width in pixels
+    int height;  // Image height in pixels
     std::vector<Pixel> data;  // Vector to store the pixel data of the image
 };
 
@@ -35,7 +41,7 @@ typedef PPMImageI::Pixel PPMPixelI; // Pixel specialization for integer image
 // Function to serialize a PPMImage and write it to an output stream
 inline static void serializePPMImage(std::ostream& outputStream, const PPMImageI& ppmImage) {
     outputStream << "P3\n";                          // PPM image format identifier
-    outputStream << IMG_WIDTH << " " << IMG_HEIGHT << "\n"; // Image width and height
+    outputStream << ppmImage.width << " " << ppmImage.height << "\n"; // Image width and height
     outputStream << MAX_COLOR_COMP << "\n";          // Maximum color component value
 
     // Loop through each pixel and write its RGB values to the output stream
@@ -43,7 +49,7 @@ inline static void serializePPMImage(std::ostream& outputStream, const PPMImageI
         outputStream << pixel.r << " " << pixel.g << " " << pixel.b << " ";
 
         // Add a new line character after writing each row of pixels
-        if (c == IMG_WIDTH * row) {
+        if (c == ppmImage.width * row) {
             outputStream << "\n";
             row++;
         }
@@ -51,4 +57,60 @@ inline static void serializePPMImage(std::ostream& outputStream, const PPMImageI
     }
 }
 
+// Reads an image written by serializePPMImage. Returns false if the stream doesn't hold one
+inline static bool readPPMImage(std::istream& inputStream, PPMImageI& ppmImage) {
+    std::string format;
+    int maxColorComp = 0;
+    inputStream >> format >> ppmImage.width >> ppmImage.height >> maxColorComp;
+    if (!inputStream || format != "P3" || ppmImage.width <= 0 || ppmImage.height <= 0) {
+        return false;
+    }
+
+    ppmImage.data.assign(size_t(ppmImage.width) * ppmImage.height, PPMPixelI());
+    for (PPMPixelI& pixel : ppmImage.data) {
+        inputStream >> pixel.r >> pixel.g >> pixel.b;
+    }
+    return bool(inputStream);
+}
+
+// Returns a 64-bit FNV-1a hash of the pixel colors, which changes when any pixel does
+inline static uint64_t getImageChecksum(const PPMImageI& ppmImage) {
+    uint64_t hash = 14695981039346656037ull;
+    for (const PPMPixelI& pixel : ppmImage.data) {
+        for (const int comp : { pixel.r, pixel.g, pixel.b }) {
+            hash = (hash ^ uint64_t(uint32_t(comp))) * 1099511628211ull;
+        }
+    }
+    return hash;
+}
+
+// Formats a checksum as 16 hexadecimal digits
+inline static std::string formatChecksum(const uint64_t checksum) {
+    std::string hex(16, '0');
+    for (int i = 15, shift = 0; i >= 0; i--, shift += 4) {
+        hex[i] = "0123456789abcdef"[(checksum >> shift) & 0xf];
+    }
+    return hex;
+}
+
+// Returns the peak signal-to-noise ratio of _ppmImage_ against _reference_ in dB, which is
+// infinity for equal images and 0 for images of different sizes
+inline static double computePSNR(const PPMImageI& ppmImage, const PPMImageI& reference) {
+    if (ppmImage.width != reference.width || ppmImage.height != reference.height) {
+        return 0.0;
+    }
+    double squaredError = 0.0;
+    for (size_t i = 0; i < ppmImage.data.size(); i++) {
+        for (int comp = 0; comp < 3; comp++) {
+            const double diff = double(ppmImage.data[i].color[comp] - reference.data[i].color[comp]);
+            squaredError += diff * diff;
+        }
+    }
+    if (squaredError == 0.0) {
+        return std::numeric_limits<double>::infinity();
+    }
+    const double meanSquaredError = squaredError / (3.0 * ppmImage.data.size());
+    return 10.0 * std::log10(double(MAX_COLOR_COMP) * MAX_COLOR_COMP / meanSquaredError);
+}
+
 #endif
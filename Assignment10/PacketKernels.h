@@ -0,0 +1,161 @@
+#ifndef PACKETKERNELS_H
+#define PACKETKERNELS_H
+
+// Ray packet intersection kernels. They are compiled once per instruction set by the
+// PacketKernels*.cpp files and picked at startup by CpuDispatch, so this header must not pull in
+// any function with external linkage: such a function could be compiled with AVX in one of those
+// files and then be called from a CPU without it. Only plain types and macros and internal
+// linkage functions over raw float arrays are allowed here.
+#include <cfloat>
+#include <cstdint>
+
+// Ray data of a packet of _N_ rays stored as structure of arrays
+template <int N>
+struct PacketRays {
+    alignas(64) float originX[N], originY[N], originZ[N];
+    alignas(64) float dirX[N], dirY[N], dirZ[N];
+    alignas(64) float invDirX[N], invDirY[N], invDirZ[N];
+    alignas(64) float tMax[N];
+    bool active[N];  // Lanes without a ray (outside of the image) are inactive
+};
+
+// Closest hits found for the rays of a packet
+template <int N>
+struct PacketHits {
+    int32_t meshIdx[N];      // Index of the hit mesh in the scene objects, -1 if the ray missed
+    int32_t triangleIdx[N];  // Index of the hit triangle in the mesh
+};
+
+// Kernels of one instruction set for packets of _N_ rays
+template <int N>
+struct PacketKernels {
+    // Tests the active rays against the box given by its min and max corners with the slab method
+    // of BBox::intersect. Marks the rays that hit it in _hitMask_ and returns their number
+    int (*intersectBox)(const PacketRays<N>& rays, const float* boxMin, const float* boxMax, bool* hitMask);
+
+    // Tests the rays in _laneMask_ against _numTriangles_ triangles with the Moller-Trumbore method
+    // of Triangle::intersectMT. _positions_ holds the vertices 4 floats apart (x, y, z, padding)
+    // and _indices_ 3 vertex indices per triangle. Closer hits shorten tMax and go to _hits_. As in
+    // Scene::intersect, a tie with the tMax the rays came in with keeps the hit of the earlier mesh,
+    // while within the mesh a tie goes to the later triangle, as in TriangleMesh::intersect
+    void (*intersectTriangles)(PacketRays<N>& rays, const bool* laneMask, const float* positions,
+        const int32_t* indices, int32_t numTriangles, int32_t meshIdx, PacketHits<N>& hits);
+};
+
+// The kernels of all packet sizes for one instruction set
+struct KernelSet {
+    const char* name;
+    PacketKernels<4> packet4;
+    PacketKernels<8> packet8;
+};
+
+// Kernel sets compiled for each instruction set, see PacketKernels*.cpp
+KernelSet makeKernelSetSSE2();
+KernelSet makeKernelSetAVX2();
+KernelSet makeKernelSetAVX512();
+
+// Same as std::min and std::max, including which operand is returned for NaN
+inline static float kernelMin(const float a, const float b) { return b < a ? b : a; }
+
+inline static float kernelMax(const float a, const float b) { return a < b ? b : a; }
+
+static constexpr float KERNEL_EPSILON = FLT_EPSILON * 0.5f;  // EPSILON from Constants.h
+
+// The lane loops of the kernels below are written to be vectorized by the compiler: the
+// conditions are combined with & instead of &&, and the results are kept in local arrays and
+// written out once, since a conditional store to the output could be neither if-converted nor
+// proven not to alias the inputs
+
+template <int N>
+inline static int intersectBoxKernel(const PacketRays<N>& rays, const float* boxMin, const float* boxMax,
+    bool* hitMask) {
+    // 1 + 2 * gamma(3) from AABBox.h, the bound of the rounding error of tFar
+    constexpr float tFarScale = 1 + 2 * ((3 * KERNEL_EPSILON) / (1 - 3 * KERNEL_EPSILON));
+    int32_t laneHits[N];
+    for (int lane = 0; lane < N; lane++) {
+        const float tNearX = (boxMin[0] - rays.originX[lane]) * rays.invDirX[lane];
+        const float tFarX = (boxMax[0] - rays.originX[lane]) * rays.invDirX[lane];
+        const float tNearY = (boxMin[1] - rays.originY[lane]) * rays.invDirY[lane];
+        const float tFarY = (boxMax[1] - rays.originY[lane]) * rays.invDirY[lane];
+        const float tNearZ = (boxMin[2] - rays.originZ[lane]) * rays.invDirZ[lane];
+        const float tFarZ = (boxMax[2] - rays.originZ[lane]) * rays.invDirZ[lane];
+
+        const float t0 = kernelMax(kernelMax(kernelMax(0.f, kernelMin(tNearX, tFarX)),
+            kernelMin(tNearY, tFarY)), kernelMin(tNearZ, tFarZ));
+        const float t1 = kernelMin(kernelMin(kernelMin(FLT_MAX, kernelMax(tNearX, tFarX) * tFarScale),
+            kernelMax(tNearY, tFarY) * tFarScale), kernelMax(tNearZ, tFarZ) * tFarScale);
+        laneHits[lane] = rays.active[lane] & (t0 <= t1);
+    }
+
+    int numHits = 0;
+    for (int lane = 0; lane < N; lane++) {
+        hitMask[lane] = laneHits[lane];
+        numHits += laneHits[lane];
+    }
+    return numHits;
+}
+
+template <int N>
+inline static void intersectTrianglesKernel(PacketRays<N>& rays, const bool* laneMask, const float* positions,
+    const int32_t* indices, const int32_t numTriangles, const int32_t meshIdx, PacketHits<N>& hits) {
+    float tMax[N];
+    int32_t hitTriangle[N];
+    int32_t testLane[N];
+    for (int lane = 0; lane < N; lane++) {
+        tMax[lane] = rays.tMax[lane];
+        hitTriangle[lane] = -1;
+        testLane[lane] = laneMask[lane];
+    }
+
+    for (int32_t t = 0; t < numTriangles; t++) {
+        const float* A = positions + 4 * indices[3 * t];
+        const float* B = positions + 4 * indices[3 * t + 1];
+        const float* C = positions + 4 * indices[3 * t + 2];
+        const float ABx = B[0] - A[0], ABy = B[1] - A[1], ABz = B[2] - A[2];
+        const float ACx = C[0] - A[0], ACy = C[1] - A[1], ACz = C[2] - A[2];
+
+        for (int lane = 0; lane < N; lane++) {
+            // pVec = cross(ray.dir, AC)
+            const float pVecX = rays.dirY[lane] * ACz - rays.dirZ[lane] * ACy;
+            const float pVecY = rays.dirZ[lane] * ACx - rays.dirX[lane] * ACz;
+            const float pVecZ = rays.dirX[lane] * ACy - rays.dirY[lane] * ACx;
+            const float det = ABx * pVecX + ABy * pVecY + ABz * pVecZ;
+            const float invDet = 1 / det;
+
+            const float tVecX = rays.originX[lane] - A[0];
+            const float tVecY = rays.originY[lane] - A[1];
+            const float tVecZ = rays.originZ[lane] - A[2];
+            const float u = (tVecX * pVecX + tVecY * pVecY + tVecZ * pVecZ) * invDet;
+
+            // qVec = cross(tVec, AB)
+            const float qVecX = tVecY * ABz - tVecZ * ABy;
+            const float qVecY = tVecZ * ABx - tVecX * ABz;
+            const float qVecZ = tVecX * ABy - tVecY * ABx;
+            const float v =
+                (rays.dirX[lane] * qVecX + rays.dirY[lane] * qVecY + rays.dirZ[lane] * qVecZ) * invDet;
+            const float tHit = (ACx * qVecX + ACy * qVecY + ACz * qVecZ) * invDet;
+
+            const bool closer = (tHit < tMax[lane]) | ((tHit == tMax[lane]) & (hitTriangle[lane] >= 0));
+            const bool hit = testLane[lane] & ((det >= KERNEL_EPSILON) | (det <= -KERNEL_EPSILON)) &
+                (u >= 0) & (u <= 1) & (v >= 0) & (u + v <= 1) & (tHit >= 0) & closer;
+            tMax[lane] = hit ? tHit : tMax[lane];
+            hitTriangle[lane] = hit ? t : hitTriangle[lane];
+        }
+    }
+
+    for (int lane = 0; lane < N; lane++) {
+        const bool hit = hitTriangle[lane] >= 0;
+        rays.tMax[lane] = tMax[lane];
+        hits.meshIdx[lane] = hit ? meshIdx : hits.meshIdx[lane];
+        hits.triangleIdx[lane] = hit ? hitTriangle[lane] : hits.triangleIdx[lane];
+    }
+}
+
+// Returns the kernels instantiated in the including translation unit
+inline static KernelSet makeKernelSet(const char* name) {
+    return KernelSet{ name,
+        PacketKernels<4>{ &intersectBoxKernel<4>, &intersectTrianglesKernel<4> },
+        PacketKernels<8>{ &intersectBoxKernel<8>, &intersectTrianglesKernel<8> } };
+}
+
+#endif
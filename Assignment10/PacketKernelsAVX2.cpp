@@ -0,0 +1,15 @@
+// Packet kernels built for AVX2. MSVC builds this file with /arch:AVX2 (see the project file),
+// GCC and Clang through the target pragmas. FMA is left out so every path finds the same hits
+#if defined(__clang__) && (defined(__x86_64__) || defined(__i386__))
+#pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#pragma GCC target("avx2")
+#endif
+
+#include "PacketKernels.h"
+
+KernelSet makeKernelSetAVX2() { return makeKernelSet("avx2"); }
+
+#if defined(__clang__) && (defined(__x86_64__) || defined(__i386__))
+#pragma clang attribute pop
+#endif
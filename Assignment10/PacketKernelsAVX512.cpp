@@ -0,0 +1,15 @@
+// Packet kernels built for AVX-512. MSVC builds this file with /arch:AVX512 (see the project file),
+// GCC and Clang through the target pragmas. FMA is left out so every path finds the same hits
+#if defined(__clang__) && (defined(__x86_64__) || defined(__i386__))
+#pragma clang attribute push(__attribute__((target("avx512f,avx512vl"))), apply_to = function)
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#pragma GCC target("avx512f,avx512vl")
+#endif
+
+#include "PacketKernels.h"
+
+KernelSet makeKernelSetAVX512() { return makeKernelSet("avx512"); }
+
+#if defined(__clang__) && (defined(__x86_64__) || defined(__i386__))
+#pragma clang attribute pop
+#endif
@@ -0,0 +1,4 @@
+// Baseline packet kernels, built with the default instruction set of the target
+#include "PacketKernels.h"
+
+KernelSet makeKernelSetSSE2() { return makeKernelSet("sse2"); }
@@ -6,10 +6,12 @@
 #include "CRTCamera.h"
 #include "PointLight.h"
 #include "Material.h"
+#include "MeshDedup.h"
 #include "rapidjson/document.h"
 #include "rapidjson/istreamwrapper.h"
 #include <vector>
 #include "CRTTriangle.h"
+#include "TraceRecorder.h"
 #include <iostream>
 
 using namespace rapidjson;
@@ -67,10 +69,56 @@ inline static std::vector<TriangleIndices> loadTriangleIndices(const Value::Cons
 
 class Parser {
 public:
-    // Retrieves scene objects from given input json
+    // Checks that _inputFile_ can be read and holds a JSON object with the members the other parse
+    // functions expect, which fail on assertions otherwise, so a malformed scene is reported
+    // instead of stopping the process
+    static int32_t checkSceneFile(std::string_view inputFile) {
+        CRT_TRACE_SCOPE("check scene", "parse");
+        std::ifstream inputFileStream(inputFile.data());
+        if (!inputFileStream.good()) {
+            std::cerr << "Input file stream " << inputFile << " not good" << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        BasicIStreamWrapper<std::ifstream> istreamWrapper(inputFileStream);
+        Document doc;
+        doc.ParseStream(istreamWrapper);
+        if (doc.HasParseError() || !doc.IsObject()) {
+            std::cerr << "Failed to parse " << inputFile << " as a JSON object." << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        for (const char* member : { SceneConstants::STR_SCENE_SETTINGS, SceneConstants::STR_CAMERA_SETTINGS,
+            SceneConstants::STR_SCENE_OBJECT, SceneConstants::STR_MATERIAL_INFO }) {
+            if (!doc.HasMember(member)) {
+                std::cerr << "Scene " << inputFile << " has no " << member << "." << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+        const Value& sceneSettings = doc.FindMember(SceneConstants::STR_SCENE_SETTINGS)->value;
+        if (!sceneSettings.IsObject() || !sceneSettings.HasMember(SceneConstants::STR_IMAGE_SETTINGS)) {
+            std::cerr << "Failed to parse scene settings." << std::endl;
+            return EXIT_FAILURE;
+        }
+        const Value& imageSettings = sceneSettings.FindMember(SceneConstants::STR_IMAGE_SETTINGS)->value;
+        if (!imageSettings.IsObject() || !imageSettings.HasMember(SceneConstants::STR_IMAGE_WIDTH) ||
+            !imageSettings.HasMember(SceneConstants::STR_IMAGE_HEIGHT) ||
+            !imageSettings.FindMember(SceneConstants::STR_IMAGE_WIDTH)->value.IsInt() ||
+            !imageSettings.FindMember(SceneConstants::STR_IMAGE_HEIGHT)->value.IsInt()) {
+            std::cerr << "Failed to parse image settings." << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        return EXIT_SUCCESS;
+    }
+
+    // Retrieves scene objects from given input json. Duplicated vertices are welded and objects
+    // with identical geometry share it, _dedupStats_ records the memory saved by that
     static int32_t parseSceneObjects(std::string_view inputFile,
-        std::vector<TriangleMesh>& sceneObjects) {
+        std::vector<TriangleMesh>& sceneObjects, MeshDedupStats& dedupStats) {
+        CRT_TRACE_SCOPE("parse objects", "parse");
         Document doc = getJsonDocument(inputFile);
+        MeshGeometryCache geometryCache;
 
         const Value& objects = doc.FindMember(SceneConstants::STR_SCENE_OBJECT)->value;
         if (!objects.IsArray()) {
@@ -99,9 +147,13 @@ public:
                 return EXIT_FAILURE;
             }
 
-            sceneObjects.emplace_back(loadVertices(vertices.GetArray()),
-                loadTriangleIndices(triangleIndices.GetArray()),
-                materialIdx.GetInt());
+            std::vector<Pointf> vertPositions = loadVertices(vertices.GetArray());
+            std::vector<TriangleIndices> vertIndices = loadTriangleIndices(triangleIndices.GetArray());
+            dedupStats.bytesBefore += calcGeometryMemory(vertPositions.size(), vertIndices.size());
+            weldVertices(vertPositions, vertIndices, WELD_EPSILON, dedupStats);
+
+            sceneObjects.emplace_back(geometryCache.getOrCreate(std::move(vertPositions),
+                std::move(vertIndices), dedupStats), materialIdx.GetInt());
         }
 
         return EXIT_SUCCESS;
@@ -109,6 +161,7 @@ public:
 
     // Retrieves camera settings from given input json
     static int32_t parseCameraParameters(std::string_view inputFile, CRTCamera& camera) {
+        CRT_TRACE_SCOPE("parse camera", "parse");
         SceneDimensions sceneDimens;
         Document doc = getJsonDocument(inputFile);
 
@@ -141,6 +194,7 @@ public:
 
     // Retrieves scene settings from given input json
     static int32_t parseSceneSettings(std::string_view inputFile, SceneSettings& settings) {
+        CRT_TRACE_SCOPE("parse settings", "parse");
         Document doc = getJsonDocument(inputFile);
 
         /// set background color
@@ -166,6 +220,7 @@ public:
 
     // Retrieves scene lights from given input json
     static int32_t parseSceneLights(std::string_view inputFile, std::vector<PointLight>& sceneLights) {
+        CRT_TRACE_SCOPE("parse lights", "parse");
         Document doc = getJsonDocument(inputFile);
 
         const Value& lightSettings = doc.FindMember(SceneConstants::STR_SCENE_LIGHTS)->value;
@@ -203,6 +258,7 @@ public:
 
     // Retrieves scene materials fron given input json
     static int32_t parseMaterials(std::string_view inputFile, std::vector<Material>& materials) {
+        CRT_TRACE_SCOPE("parse materials", "parse");
         Document doc = getJsonDocument(inputFile);
 
         const Value& materialsInfo = doc.FindMember(SceneConstants::STR_MATERIAL_INFO)->value;
@@ -218,6 +274,11 @@ public:
                 std::cerr << "Failed to parse material type." << std::endl;
                 return EXIT_FAILURE;
             }
+            // the material tables are indexed by type, so an unsupported one can't be stored
+            if (getMaterialType(mType.GetString()) == MaterialType::Undefined) {
+                std::cerr << "Unsupported material type " << mType.GetString() << "." << std::endl;
+                return EXIT_FAILURE;
+            }
 
             const Value& albedo = materialsInfo[i].FindMember(SceneConstants::STR_MATERIAL_ALBEDO)->value;
             const Value& ior = materialsInfo[i].FindMember(SceneConstants::STR_MATERIAL_IOR)->value;
@@ -248,6 +309,7 @@ public:
 private:
     // Retrieves json document from input stream
     static Document getJsonDocument(std::string_view inputFile) {
+        CRT_TRACE_SCOPE("read json", "parse");
         std::ifstream inputFileStream(inputFile.data());
         if (!inputFileStream.good()) {
             std::cout << "Input file stream " << inputFile << " not good\n";
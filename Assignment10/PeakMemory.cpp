@@ -0,0 +1,56 @@
+#include "PeakMemory.h"
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+
+uint64_t getPeakMemoryBytes() {
+    PROCESS_MEMORY_COUNTERS counters{};
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return 0;
+    }
+    return counters.PeakWorkingSetSize;
+}
+
+bool resetPeakMemory() { return false; }
+#elif defined(__linux__)
+#include <fstream>
+#include <string>
+
+// The peak is read from VmHWM of /proc/self/status, since it's the value clear_refs resets,
+// unlike the ru_maxrss of getrusage
+uint64_t getPeakMemoryBytes() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.rfind("VmHWM:", 0) == 0) {
+            return std::stoull(line.substr(6)) * 1024;  // Given in kB
+        }
+    }
+    return 0;
+}
+
+bool resetPeakMemory() {
+    std::ofstream clearRefs("/proc/self/clear_refs");
+    clearRefs << "5";
+    clearRefs.close();
+    return clearRefs.good();
+}
+#else
+#include <sys/resource.h>
+
+uint64_t getPeakMemoryBytes() {
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#if defined(__APPLE__)
+    return uint64_t(usage.ru_maxrss);  // Given in bytes on macOS and in kB elsewhere
+#else
+    return uint64_t(usage.ru_maxrss) * 1024;
+#endif
+}
+
+bool resetPeakMemory() { return false; }
+#endif
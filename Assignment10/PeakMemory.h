@@ -0,0 +1,14 @@
+#ifndef PEAKMEMORY_H
+#define PEAKMEMORY_H
+
+#include <cstdint>
+
+// Returns the most resident memory the process has used, in bytes, or 0 if the OS doesn't report it
+uint64_t getPeakMemoryBytes();
+
+// Starts measuring the peak memory again from the current usage, so the next getPeakMemoryBytes
+// covers only what follows. Returns false if the OS can't reset it (only Linux can), in which case
+// the peak keeps covering the whole lifetime of the process
+bool resetPeakMemory();
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <cstdint>
+
+// Small and fast pseudo-random number generator (PCG32)
+// source https://www.pcg-random.org/download.html
+class RNG {
+public:
+    RNG() = delete;
+
+    // Initializes the generator, each _seed_ produces a different independent sequence
+    explicit RNG(const uint64_t seed) {
+        state = 0u;
+        uniformUInt32();
+        state += seed;
+        uniformUInt32();
+    }
+
+    // Returns uniformly distributed integer in [0, 2^32)
+    uint32_t uniformUInt32() {
+        const uint64_t oldState = state;
+        state = oldState * MULTIPLIER + INCREMENT;
+        const uint32_t xorShifted = uint32_t(((oldState >> 18u) ^ oldState) >> 27u);
+        const uint32_t rot = uint32_t(oldState >> 59u);
+        return (xorShifted >> rot) | (xorShifted << ((~rot + 1u) & 31));
+    }
+
+    // Returns uniformly distributed float in [0, 1)
+    float uniformFloat() { return (uniformUInt32() >> 8) * 0x1p-24f; }
+
+private:
+    static constexpr uint64_t MULTIPLIER = 6364136223846793005ull;
+    static constexpr uint64_t INCREMENT = 1442695040888963407ull;
+
+    uint64_t state;
+};
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef RAYPACKET_H
+#define RAYPACKET_H
+
+#include <cstdint>
+#include "CpuDispatch.h"
+#include "Scene.h"
+
+static_assert(sizeof(Pointf) == 4 * sizeof(float), "Packet kernels read the vertex positions 4 floats apart");
+static_assert(sizeof(TriangleIndices) == 3 * sizeof(int32_t), "Packet kernels read 3 indices per triangle");
+
+// Packet of _N_ rays stored as structure of arrays, so that each test runs over all lanes at once
+template <int N>
+struct RayPacket : PacketRays<N> {
+    static constexpr int size = N;
+
+    // Stores the camera rays of the _width_ x N / _width_ pixel block whose top left pixel is
+    // (_row_, _col_), lane by lane in row-major order
+    void setCameraRays(const CRTCamera& camera, const uint32_t row, const uint32_t col, const uint32_t width) {
+        camera.getTileRayDirs(row, col, N / width, width, this->dirX, this->dirY, this->dirZ);
+        const Pointf origin = camera.getLookFrom();
+        for (int lane = 0; lane < N; lane++) {
+            this->originX[lane] = origin.x, this->originY[lane] = origin.y, this->originZ[lane] = origin.z;
+            this->invDirX[lane] = 1 / this->dirX[lane];
+            this->invDirY[lane] = 1 / this->dirY[lane];
+            this->invDirZ[lane] = 1 / this->dirZ[lane];
+            this->tMax[lane] = MAX_FLOAT;
+            this->active[lane] = true;
+        }
+    }
+
+    CRTRay getRay(const int lane) const {
+        return CRTRay(Pointf(this->originX[lane], this->originY[lane], this->originZ[lane]),
+            CRTVectorf(this->dirX[lane], this->dirY[lane], this->dirZ[lane]));
+    }
+};
+
+// Finds the closest hit of each ray in the packet with the packet kernels of the selected CPU
+// path. Meshes are tested with the whole packet while at least half of its rays hit the mesh
+// bounds, otherwise the remaining rays are traced one by one
+template <int N>
+inline static void intersectPacket(const Scene* scene, const PacketKernels<N>& kernels, RayPacket<N>& packet,
+    PacketHits<N>& hits) {
+    for (int lane = 0; lane < N; lane++) {
+        hits.meshIdx[lane] = -1;
+        hits.triangleIdx[lane] = -1;
+    }
+
+    const std::vector<TriangleMesh>& meshes = scene->getObjects();
+    [[maybe_unused]] int numActive = 0;
+    for (int lane = 0; lane < N; lane++) {
+        numActive += packet.active[lane];
+    }
+    bool boxMask[N];
+    for (int32_t meshIdx = 0; meshIdx < int32_t(meshes.size()); meshIdx++) {
+        const MeshGeometry& geometry = *meshes[meshIdx].geometry;
+        const std::vector<TriangleIndices>& vertIndices = geometry.vertIndices;
+        if (vertIndices.empty())
+            continue;
+        const int numBoxHits = kernels.intersectBox(packet, &geometry.bounds.min.x, &geometry.bounds.max.x, boxMask);
+        CRT_COUNT(BoundsTests, numActive);
+        if (numBoxHits == 0)
+            continue;
+
+        // counted here rather than in the kernels, which must not touch the thread counters
+        CRT_COUNT(TriangleTests, uint64_t(numBoxHits) * vertIndices.size());
+
+        if (2 * numBoxHits >= N) {
+            kernels.intersectTriangles(packet, boxMask, &geometry.vertPositions[0].x, vertIndices[0].data(),
+                int32_t(vertIndices.size()), meshIdx, hits);
+            continue;
+        }
+
+        // the packet has diverged, so trace the few rays that hit the mesh bounds separately
+        for (int lane = 0; lane < N; lane++) {
+            if (!boxMask[lane])
+                continue;
+            CRTRay ray = packet.getRay(lane);
+            ray.tMax = packet.tMax[lane];
+            InfoIntersect info;
+            bool meshHit = false;
+            for (int32_t t = 0; t < int32_t(vertIndices.size()); t++) {
+                // a tie with an earlier mesh keeps that mesh, as in Scene::intersect
+                if (Triangle(vertIndices[t], &meshes[meshIdx]).intersectMT(ray, info) &&
+                    (meshHit || info.t < packet.tMax[lane])) {
+                    meshHit = true;
+                    ray.tMax = info.t;
+                    hits.meshIdx[lane] = meshIdx;
+                    hits.triangleIdx[lane] = t;
+                }
+            }
+            packet.tMax[lane] = ray.tMax;
+        }
+    }
+}
+
+// Computes the full intersection data of lane _lane_ from the triangle found by intersectPacket,
+// as Scene::intersect would. Returns false if the ray missed
+template <int N>
+inline static bool getPacketHitInfo(const Scene* scene, const RayPacket<N>& packet,
+    const PacketHits<N>& hits, const int lane, InfoIntersect& info) {
+    if (hits.meshIdx[lane] < 0)
+        return false;
+
+    const TriangleMesh& mesh = scene->getObjects()[hits.meshIdx[lane]];
+    const Triangle triangle(mesh.geometry->vertIndices[hits.triangleIdx[lane]], &mesh);
+    info.objectIdx = hits.meshIdx[lane];
+    return triangle.intersectMT(packet.getRay(lane), info);
+}
+
+#endif
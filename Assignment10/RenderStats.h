@@ -0,0 +1,347 @@
+#ifndef RENDERSTATS_H
+#define RENDERSTATS_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "HardwareCounters.h"
+#include "PPMImage.h"
+#include "Timer.h"
+
+// The hot-path counters are compiled in unless CRT_ENABLE_STATS is defined as 0
+#ifndef CRT_ENABLE_STATS
+#define CRT_ENABLE_STATS 1
+#endif
+
+// Events counted while rendering
+enum class Stat : int {
+    CameraRays, ShadowRays, ReflectionRays, RefractionRays, BoundsTests, TriangleTests, Hits, Count
+};
+
+inline static const char* getStatName(const Stat stat) {
+    static const char* statNames[int(Stat::Count)] = { "camera_rays", "shadow_rays", "reflection_rays",
+        "refraction_rays", "bounds_tests", "triangle_tests", "hits" };
+    return statNames[int(stat)];
+}
+
+// Counters of a single thread
+struct StatCounters {
+    std::array<uint64_t, int(Stat::Count)> counts{};
+    int maxRayDepth = 0;
+
+    uint64_t operator[](const Stat stat) const { return counts[int(stat)]; }
+
+    // Returns the number of rays of all kinds traced
+    uint64_t getNumRays() const {
+        return counts[int(Stat::CameraRays)] + counts[int(Stat::ShadowRays)] + counts[int(Stat::ReflectionRays)] +
+            counts[int(Stat::RefractionRays)];
+    }
+
+    void add(const StatCounters& other) {
+        for (int i = 0; i < int(Stat::Count); i++) {
+            counts[i] += other.counts[i];
+        }
+        maxRayDepth = std::max(maxRayDepth, other.maxRayDepth);
+    }
+};
+
+// Keeps track of the counters of every thread, so they can be merged once rendering is done
+class StatRegistry {
+public:
+    static StatRegistry& get() {
+        static StatRegistry registry;
+        return registry;
+    }
+
+    void add(StatCounters* counters) {
+        std::lock_guard<std::mutex> lock(mutex);
+        threadCounters.push_back(counters);
+    }
+
+    // Keeps the counts of a thread that exits until the next collect
+    void remove(StatCounters* counters) {
+        std::lock_guard<std::mutex> lock(mutex);
+        exitedThreadCounters.add(*counters);
+        threadCounters.erase(std::find(threadCounters.begin(), threadCounters.end(), counters));
+    }
+
+    // Returns the sum of the counters of all threads and resets them.
+    // Must be called only while no thread is rendering
+    StatCounters collect() {
+        std::lock_guard<std::mutex> lock(mutex);
+        StatCounters total = exitedThreadCounters;
+        exitedThreadCounters = StatCounters();
+        for (StatCounters* counters : threadCounters) {
+            total.add(*counters);
+            *counters = StatCounters();
+        }
+        return total;
+    }
+
+private:
+    StatRegistry() = default;
+
+    std::mutex mutex;
+    std::vector<StatCounters*> threadCounters;
+    StatCounters exitedThreadCounters;
+};
+
+// Counters of a thread that register themselves for the lifetime of the thread
+struct ThreadStatCounters {
+    ThreadStatCounters() { StatRegistry::get().add(&counters); }
+    ~ThreadStatCounters() { StatRegistry::get().remove(&counters); }
+
+    StatCounters counters;
+};
+
+// Not static, so every translation unit counts into the same per-thread counters
+inline StatCounters& getThreadStatCounters() {
+    thread_local ThreadStatCounters threadCounters;
+    return threadCounters.counters;
+}
+
+#if CRT_ENABLE_STATS
+#define CRT_COUNT(stat, n) (getThreadStatCounters().counts[int(Stat::stat)] += (n))
+#define CRT_COUNT_RAY_DEPTH(depth) \
+    (getThreadStatCounters().maxRayDepth = std::max(getThreadStatCounters().maxRayDepth, int(depth)))
+#else
+#define CRT_COUNT(stat, n) ((void)0)
+#define CRT_COUNT_RAY_DEPTH(depth) ((void)0)
+#endif
+
+// Phases of rendering a scene file
+enum class Phase : int { Parse, Build, Render, Write, Count };
+
+inline static const char* getPhaseName(const Phase phase) {
+    static const char* phaseNames[int(Phase::Count)] = { "parse", "build", "render", "write" };
+    return phaseNames[int(phase)];
+}
+
+// Writes _str_ to _out_ as a quoted JSON string, escaping quotes, backslashes and control characters
+inline static void writeJsonString(std::ostream& out, const std::string_view str) {
+    static const char* hexDigits = "0123456789abcdef";
+    out << '"';
+    for (const char c : str) {
+        switch (c) {
+        case '"': out << "\\\""; break;
+        case '\\': out << "\\\\"; break;
+        case '\n': out << "\\n"; break;
+        case '\r': out << "\\r"; break;
+        case '\t': out << "\\t"; break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                out << "\\u00" << hexDigits[c >> 4] << hexDigits[c & 0xf];
+            } else {
+                out << c;
+            }
+        }
+    }
+    out << '"';
+}
+
+// Quality reduction applied while rendering with a time budget, see Deadline.h
+struct Degradation {
+    const char* name;
+    double progress;         // Fraction of the pixels rendered when it was applied
+    int64_t elapsedNanoSec;  // Render time when it was applied
+};
+
+// Outcome of rendering with a time budget
+struct DeadlineReport {
+    int64_t budgetNanoSec = 0;  // Time budget of the render phase, 0 if it had none
+    std::vector<Degradation> degradations;  // In the order they were applied
+    int antialiasSamples = 1;  // Samples per axis the edge pixels were antialiased with
+};
+
+// Statistics of rendering a scene file
+struct RenderStats {
+    std::string sceneFile;
+    int width = 0;
+    int height = 0;
+    unsigned numThreads = 0;
+    StatCounters counters;  // Merged counters of all rendering threads
+    std::array<int64_t, int(Phase::Count)> phaseNanoSec{};
+    uint64_t peakMemoryBytes = 0;  // Peak resident memory while rendering the scene, see PeakMemory.h
+    uint64_t imageChecksum = 0;    // getImageChecksum of the rendered image
+    bool hwCountersEnabled = false;  // Whether _phaseHwCounters_ were counted, see HardwareCounters.h
+    std::array<HwCounterValues, int(Phase::Count)> phaseHwCounters{};
+    DeadlineReport deadline;
+
+    // Returns whether the render phase finished within the time budget, true if it had none
+    bool isDeadlineMet() const {
+        return deadline.budgetNanoSec == 0 || phaseNanoSec[int(Phase::Render)] <= deadline.budgetNanoSec;
+    }
+
+    double getRaysPerSec() const {
+        const int64_t renderNanoSec = phaseNanoSec[int(Phase::Render)];
+        return renderNanoSec > 0 ? counters.getNumRays() * 1e9 / renderNanoSec : 0.0;
+    }
+
+    double getTestsPerRay() const {
+        const uint64_t totalRays = counters.getNumRays();
+        return totalRays > 0 ?
+            double(counters[Stat::BoundsTests] + counters[Stat::TriangleTests]) / totalRays : 0.0;
+    }
+
+    // Returns the hardware events of the render phase per ray traced
+    double getHwCounterPerRay(const HwCounter counter) const {
+        const uint64_t totalRays = counters.getNumRays();
+        return totalRays > 0 ? double(phaseHwCounters[int(Phase::Render)][counter]) / totalRays : 0.0;
+    }
+
+    void print(std::ostream& out) const {
+        out << "Render statistics of " << sceneFile << ":\n";
+        for (int i = 0; i < int(Phase::Count); i++) {
+            out << "  " << getPhaseName(Phase(i)) << ": " << Timer::toMilliSec<float>(phaseNanoSec[i]) << "ms\n";
+        }
+        out << "  peak_memory: " << peakMemoryBytes / (1024.0 * 1024.0) << "MB\n";
+        out << "  image_checksum: " << formatChecksum(imageChecksum) << "\n";
+#if CRT_ENABLE_STATS
+        for (int i = 0; i < int(Stat::Count); i++) {
+            out << "  " << getStatName(Stat(i)) << ": " << counters.counts[i] << "\n";
+        }
+        out << "  max_ray_depth: " << counters.maxRayDepth << "\n";
+        out << "  " << getRaysPerSec() / 1e6 << " Mrays/s, " << getTestsPerRay() << " tests per ray\n";
+#else
+        out << "  counters disabled (CRT_ENABLE_STATS is 0)\n";
+#endif
+        if (hwCountersEnabled) {
+            printHwCounters(out);
+        }
+        if (deadline.budgetNanoSec > 0) {
+            printDeadline(out);
+        }
+    }
+
+    void writeJson(std::ostream& out) const {
+        out << "{\n  \"scene\": ";
+        writeJsonString(out, sceneFile);
+        out << ",\n  \"width\": " << width << ",\n  \"height\": " << height
+            << ",\n  \"threads\": " << numThreads << ",\n  \"phases_ms\": {";
+        for (int i = 0; i < int(Phase::Count); i++) {
+            out << (i ? ", " : " ") << "\"" << getPhaseName(Phase(i)) << "\": "
+                << Timer::toMilliSec<double>(double(phaseNanoSec[i]));
+        }
+        out << " },\n  \"peak_memory_bytes\": " << peakMemoryBytes << ",\n  \"image_checksum\": \""
+            << formatChecksum(imageChecksum) << "\"";
+        out << ",\n  \"counters_enabled\": " << (CRT_ENABLE_STATS ? "true" : "false") << ",\n  \"counters\": {";
+        for (int i = 0; i < int(Stat::Count); i++) {
+            out << (i ? ", " : " ") << "\"" << getStatName(Stat(i)) << "\": " << counters.counts[i];
+        }
+        out << ", \"max_ray_depth\": " << counters.maxRayDepth << " },\n  \"rays_per_sec\": " << getRaysPerSec()
+            << ",\n  \"tests_per_ray\": " << getTestsPerRay();
+        if (hwCountersEnabled) {
+            writeHwCountersJson(out);
+        }
+        if (deadline.budgetNanoSec > 0) {
+            writeDeadlineJson(out);
+        }
+        out << "\n}\n";
+    }
+
+private:
+    void printDeadline(std::ostream& out) const {
+        const int64_t renderNanoSec = phaseNanoSec[int(Phase::Render)];
+        out << "  time_budget: " << Timer::toMilliSec<float>(deadline.budgetNanoSec) << "ms, ";
+        if (isDeadlineMet()) {
+            out << "met with " << Timer::toMilliSec<float>(deadline.budgetNanoSec - renderNanoSec) << "ms to spare\n";
+        }
+        else {
+            out << "missed by " << Timer::toMilliSec<float>(renderNanoSec - deadline.budgetNanoSec) << "ms\n";
+        }
+        out << "  degradations:";
+        for (const Degradation& degradation : deadline.degradations) {
+            out << " " << degradation.name << " at " << 100.0 * degradation.progress << "% ("
+                << Timer::toMilliSec<float>(degradation.elapsedNanoSec) << "ms)";
+        }
+        out << (deadline.degradations.empty() ? " none\n" : "\n");
+    }
+
+    void writeDeadlineJson(std::ostream& out) const {
+        out << ",\n  \"deadline\": { \"budget_ms\": " << Timer::toMilliSec<double>(double(deadline.budgetNanoSec))
+            << ", \"met\": " << (isDeadlineMet() ? "true" : "false") << ", \"antialias_samples\": "
+            << deadline.antialiasSamples << ", \"degradations\": [";
+        for (size_t i = 0; i < deadline.degradations.size(); i++) {
+            const Degradation& degradation = deadline.degradations[i];
+            out << (i ? ", " : " ") << "{ \"name\": \"" << degradation.name << "\", \"progress\": "
+                << degradation.progress << ", \"elapsed_ms\": "
+                << Timer::toMilliSec<double>(double(degradation.elapsedNanoSec)) << " }";
+        }
+        out << (deadline.degradations.empty() ? "] }" : " ] }");
+    }
+
+    void printHwCounters(std::ostream& out) const {
+        out << "  hardware counters:\n";
+        for (int phase = 0; phase < int(Phase::Count); phase++) {
+            const HwCounterValues& values = phaseHwCounters[phase];
+            out << "    " << getPhaseName(Phase(phase)) << ":";
+            for (int i = 0; i < int(HwCounter::Count); i++) {
+                out << (i ? ", " : " ") << getHwCounterName(HwCounter(i)) << " ";
+                if (isHwCounterAvailable(HwCounter(i))) {
+                    out << values.counts[i];
+                }
+                else {
+                    out << "n/a";
+                }
+            }
+            out << ", ipc " << values.getIPC() << "\n";
+        }
+        out << "    render per ray:";
+        for (int i = 0; i < int(HwCounter::Count); i++) {
+            if (isHwCounterAvailable(HwCounter(i))) {
+                out << " " << getHwCounterName(HwCounter(i)) << " " << getHwCounterPerRay(HwCounter(i));
+            }
+        }
+        out << "\n";
+    }
+
+    // Writes the counts of the events that could be counted. Unavailable events are left out
+    void writeHwCountersJson(std::ostream& out) const {
+        out << ",\n  \"hardware_counters\": {";
+        for (int phase = 0; phase < int(Phase::Count); phase++) {
+            const HwCounterValues& values = phaseHwCounters[phase];
+            out << (phase ? ",\n    \"" : "\n    \"") << getPhaseName(Phase(phase)) << "\": {";
+            for (int i = 0; i < int(HwCounter::Count); i++) {
+                if (isHwCounterAvailable(HwCounter(i))) {
+                    out << " \"" << getHwCounterName(HwCounter(i)) << "\": " << values.counts[i] << ",";
+                }
+            }
+            out << " \"ipc\": " << values.getIPC() << " }";
+        }
+        out << ",\n    \"render_per_ray\": {";
+        for (int i = 0; i < int(HwCounter::Count); i++) {
+            if (isHwCounterAvailable(HwCounter(i))) {
+                out << " \"" << getHwCounterName(HwCounter(i)) << "\": " << getHwCounterPerRay(HwCounter(i)) << ",";
+            }
+        }
+        out << " \"rays\": " << counters.getNumRays() << " }\n  }";
+    }
+};
+
+// Measures the time and, when they are enabled, the hardware events of a phase from its creation
+class PhaseMeasure {
+public:
+    PhaseMeasure(RenderStats& _stats, const Phase _phase)
+        : stats(_stats), phase(_phase), hwStart(stats.hwCountersEnabled ? sampleHwCounters() : HwCounterValues()) {}
+
+    // Stores the measures of the phase in the stats
+    void stop() {
+        stats.phaseNanoSec[int(phase)] = timer.getElapsedNanoSec();
+        if (stats.hwCountersEnabled) {
+            stats.phaseHwCounters[int(phase)] = sampleHwCounters() - hwStart;
+        }
+    }
+
+private:
+    RenderStats& stats;
+    const Phase phase;
+    const HwCounterValues hwStart;
+    const Timer timer;
+};
+
+#endif
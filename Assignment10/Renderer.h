@@ -1,45 +1,137 @@
 #ifndef RENDERER_H
 #define RENDERER_H
 
+#include "Antialiasing.h"
+#include "Deadline.h"
 #include "PPMImage.h"
+#include "RayPacket.h"
 #include "Scene.h"
 #include "ThreadPool.h"
+#include "TileCosts.h"
 #include "Timer.h"
 
 struct RenderSettings {
     const unsigned numThreads = getHardwareThreads();  // Number of threads to use for rendering
     const size_t numPixelsPerThread = PIXELS_PER_THREAD;  // Number of pixels processed by each thread
+    const TraceSettings traceSettings{};  // Ray pruning and light sampling settings
+    const bool batchShadowRays = false;  // Traces the shadow rays of each chunk together, grouped by light
+    const bool useWavefront = false;  // Renders with the stage by stage WavefrontRenderer
+    const int packetSize = 1;  // Camera rays traced together: 1 (no packets), 4 (2x2 pixels) or 8 (4x2 pixels)
+    const bool recordTileCosts = false;  // Writes a heatmap and a CSV of the render time of each image tile
+    const int antialiasSamples = 1;  // Stratified samples per axis traced through edge pixels, 1 turns antialiasing off
+    const float antialiasThreshold = 0.1f;  // Color difference from a neighbour, as a fraction, that makes an edge
+    const bool progressive = false;  // Renders PROGRESSIVE_NUM_PASSES passes of more and more pixels with the pixel path
+    const int64_t timeBudgetMs = 0;  // Time budget of the render phase, met by reducing quality, 0 for none
 };
 
-// Performs ray tracing for a given ray in the scene and returns the computed color
-static Colorf rayTrace(const CRTRay& ray, const Scene* scene) {
-    InfoIntersect infoIntersect;
-    if (scene->intersect(ray, infoIntersect)) {
+// Converts a traced color to the color of an image pixel
+inline static Colori toPixelColor(const Colorf& color) {
+    return Colori(clamp(0.f, 1.f, color.x) * 255, clamp(0.f, 1.f, color.y) * 255, clamp(0.f, 1.f, color.z) * 255);
+}
+
+// Returns the color a ray adds to its pixel given its closest hit, or the background color
+// scaled by its weight if _infoIntersect_ is nullptr because it missed
+static Colorf shadeWeightedRay(const WeightedRay& curr, const InfoIntersect* infoIntersect,
+    const Scene* scene, TraceContext& context) {
+    if (infoIntersect) {
         // If there is an intersection, compute the shading for the intersection point using the material
-        return scene->getMaterials()[infoIntersect.materialIdx].shade(ray, scene, infoIntersect);
+        return curr.weight * shade(curr.ray, scene, *infoIntersect, curr.weight, context);
+    }
+    // If no intersection occurs, take the background color of the scene
+    return curr.weight * scene->getBackground();
+}
+
+// Traces the rays waiting in the context ray stack until it is empty and returns their color.
+// Secondary rays spawned by the materials are traced iteratively from the fixed-size stack,
+// each one adding its color scaled by the accumulated weight of its path
+static Colorf traceRayStack(const Scene* scene, TraceContext& context) {
+    Colorf pixelColor;
+    RayStack& rayStack = context.rayStack;
+    while (!rayStack.empty()) {
+        const WeightedRay curr = rayStack.pop();
+        InfoIntersect infoIntersect;
+        const bool hit = scene->intersect(curr.ray, infoIntersect);
+        pixelColor += shadeWeightedRay(curr, hit ? &infoIntersect : nullptr, scene, context);
+    }
+    return pixelColor;
+}
+
+// Performs ray tracing for a given ray in the scene and returns the computed color
+static Colorf rayTrace(const CRTRay& ray, const Scene* scene, TraceContext& context) {
+    context.rayStack.push(ray, Colorf(1.f));
+    return traceRayStack(scene, context);
+}
+
+// Traces all queued shadow rays in one pass and adds the contribution of the unoccluded ones to
+// _pixelColors_. Rays towards the same light are traced one after another for coherence
+static void traceShadowQueue(ShadowQueue& shadowQueue, const Scene* scene, Colorf* pixelColors) {
+    std::stable_sort(shadowQueue.begin(), shadowQueue.end(),
+        [](const ShadowQuery& q1, const ShadowQuery& q2) { return q1.lightIdx < q2.lightIdx; });
+    for (const ShadowQuery& query : shadowQueue) {
+        if (!scene->intersectPrim(query.ray)) {
+            pixelColors[query.pixelIdx] += query.contribution;
+        }
     }
-    // If no intersection occurs, return the background color of the scene
-    return scene->getBackground();
+    shadowQueue.clear();
 }
 
 class Renderer {
 public:
     Renderer() = delete;
 
-    // Constructor that takes a reference to a PPMImage and a pointer to a Scene
-    Renderer(PPMImageI& _ppmImage, const Scene* _scene) : ppmImage(_ppmImage), scene(_scene) {}
+    // Constructor that takes a reference to a PPMImage, a pointer to a Scene, the render settings,
+    // optionally the map to record the cost of each tile in, the map to record the camera ray hits
+    // of the pixels in, which is required for antialiasing, and a camera to render from instead of
+    // the one of the scene, so frames of an animation can share the scene
+    Renderer(PPMImageI& _ppmImage, const Scene* _scene, const RenderSettings& _settings,
+        TileCostMap* _tileCosts = nullptr, AntialiasMap* _antialias = nullptr, const CRTCamera* _camera = nullptr)
+        : ppmImage(_ppmImage), scene(_scene), settings(_settings), tileCosts(_tileCosts), antialias(_antialias),
+        camera(_camera ? *_camera : _scene->getCamera()) {}
 
     // Render function that performs the rendering process
     void render(const size_t threadId, const size_t threadCount, const size_t chunkSize = 1) {
-        const SceneDimensions& dimens = scene->getSceneDimensions();
-        const CRTCamera& camera = scene->getCamera();
+        if (settings.packetSize == 4) {
+            renderPackets<2, 2>(threadId, threadCount, chunkSize);
+            return;
+        }
+        if (settings.packetSize == 8) {
+            renderPackets<4, 2>(threadId, threadCount, chunkSize);
+            return;
+        }
+
+        std::vector<Colorf> chunkColors(chunkSize);
+        ShadowQueue shadowQueue;
         for (size_t i = (chunkSize * threadId); i < ppmImage.data.size();
             i += (chunkSize * threadCount)) {
-            for (size_t c = 0; c < chunkSize; c++) {
-                const int row = (i + c) / dimens.width;
-                const int col = (i + c) % dimens.width;
-                const CRTRay cameraRay = camera.getRay(row, col);
-                const Colorf currPixelColor = rayTrace(cameraRay, scene);
+            CRT_TRACE_SCOPE("render chunk", "render", "first_pixel", int64_t(i));
+            const size_t numChunkPixels = std::min(chunkSize, ppmImage.data.size() - i);
+            for (size_t c = 0; c < numChunkPixels; c++) {
+                const TileCostMeasure pixelCost(tileCosts);
+                // seeded per pixel so the image doesn't depend on the thread count
+                TraceContext context(settings.traceSettings, i + c);
+                if (settings.batchShadowRays) {
+                    context.shadowQueue = &shadowQueue;
+                    context.pixelIdx = uint32_t(c);
+                }
+                chunkColors[c] = tracePixel(i + c, context);
+                if (tileCosts) {
+                    tileCosts->addPixels(threadId, i + c, 1, pixelCost.getElapsedNanoSec(),
+                        pixelCost.getNumRays());
+                }
+            }
+
+            if (settings.batchShadowRays) {
+                const TileCostMeasure shadowCost(tileCosts);
+                traceShadowQueue(shadowQueue, scene, chunkColors.data());
+                if (tileCosts) {
+                    // the pixels of the chunk were counted as they were traced
+                    tileCosts->addCost(threadId, i, numChunkPixels, shadowCost.getElapsedNanoSec(),
+                        shadowCost.getNumRays());
+                }
+            }
+
+            for (size_t c = 0; c < numChunkPixels; c++) {
+                const Colorf& currPixelColor = chunkColors[c];
                 ppmImage.data[i + c].color = Colori(clamp(0.f, 1.f, currPixelColor.x) * 255,
                     clamp(0.f, 1.f, currPixelColor.y) * 255,
                     clamp(0.f, 1.f, currPixelColor.z) * 255);
@@ -47,9 +139,241 @@ public:
         }
     }
 
+    // Renders pass _pass_ of progressive rendering. Pass p traces the pixels on the grid of every
+    // _step_ = 2^(PROGRESSIVE_NUM_PASSES - 1 - p) rows and columns that the previous passes haven't
+    // traced, and fills the _step_ x _step_ block below and to the right of each with its color as
+    // a preview. The first pass traces 1/16 of the pixels, the second the rest of 1/4 and the last
+    // all remaining ones, so every pixel is traced once and the final image is the same as the one
+    // of render. Each thread takes chunks of _chunkSize_ grid cells
+    void renderPass(const size_t threadId, const size_t threadCount, const size_t chunkSize, const int pass) {
+        const SceneDimensions& dimens = scene->getSceneDimensions();
+        const int step = 1 << (PROGRESSIVE_NUM_PASSES - 1 - pass);
+        const size_t gridWidth = (dimens.width + step - 1) / step;
+        const size_t numCells = gridWidth * ((dimens.height + step - 1) / step);
+        for (size_t i = (chunkSize * threadId); i < numCells; i += (chunkSize * threadCount)) {
+            CRT_TRACE_SCOPE("render pass chunk", "render", "pass", pass);
+            const size_t lastCell = std::min(i + chunkSize, numCells);
+            for (size_t cell = i; cell < lastCell; cell++) {
+                const int row = int(cell / gridWidth) * step;
+                const int col = int(cell % gridWidth) * step;
+                // the pixels on the grid of twice the step were traced by the previous pass
+                if (pass > 0 && row % (2 * step) == 0 && col % (2 * step) == 0)
+                    continue;
+
+                const TileCostMeasure pixelCost(tileCosts);
+                const size_t pixel = size_t(row) * dimens.width + col;
+                TraceContext context(settings.traceSettings, pixel);
+                const Colori pixelColor = toPixelColor(tracePixel(pixel, context));
+                for (int r = row; r < std::min(row + step, dimens.height); r++) {
+                    for (int c = col; c < std::min(col + step, dimens.width); c++) {
+                        ppmImage.data[size_t(r) * dimens.width + c].color = pixelColor;
+                    }
+                }
+                if (tileCosts) {
+                    tileCosts->addPixels(threadId, pixel, 1, pixelCost.getElapsedNanoSec(),
+                        pixelCost.getNumRays());
+                }
+            }
+        }
+    }
+
+    // Renders the tiles _deadline_ hands out until every tile is taken, each with the pixel path at
+    // the quality level when it is taken. At the lowest level only the top left pixel of each
+    // _step_ x _step_ block is traced and its color fills the block
+    void renderTiles(const size_t threadId, DeadlineController& deadline) {
+        const int width = scene->getSceneDimensions().width;
+        ImageTile tile;
+        while (deadline.nextTile(tile)) {
+            CRT_TRACE_SCOPE("render tile", "render", "first_pixel", int64_t(tile.row) * width + tile.col);
+            const Timer tileTimer;
+            const TraceSettings& traceSettings = deadline.getTraceSettings(tile.level);
+            const int step = DeadlineController::getPixelStep(tile.level);
+            const int lastRow = tile.row + tile.numRows;
+            const int lastCol = tile.col + tile.numCols;
+            for (int row = tile.row; row < lastRow; row += step) {
+                const TileCostMeasure rowCost(tileCosts);
+                for (int col = tile.col; col < lastCol; col += step) {
+                    const size_t pixel = size_t(row) * width + col;
+                    TraceContext context(traceSettings, pixel);
+                    const Colori pixelColor = toPixelColor(tracePixel(pixel, context));
+                    for (int r = row; r < std::min(row + step, lastRow); r++) {
+                        for (int c = col; c < std::min(col + step, lastCol); c++) {
+                            ppmImage.data[size_t(r) * width + c].color = pixelColor;
+                        }
+                    }
+                }
+                if (tileCosts) {
+                    // the rows of the blocks share the cost of the pixels traced for them
+                    const int numBlockRows = std::min(step, lastRow - row);
+                    const int64_t nanoSec = rowCost.getElapsedNanoSec();
+                    const uint64_t numRays = rowCost.getNumRays();
+                    for (int r = 0; r < numBlockRows; r++) {
+                        tileCosts->addPixels(threadId, size_t(row + r) * width + tile.col, tile.numCols,
+                            nanoSec * (r + 1) / numBlockRows - nanoSec * r / numBlockRows,
+                            numRays * (r + 1) / numBlockRows - numRays * r / numBlockRows);
+                    }
+                }
+            }
+            deadline.tileDone(tile, tileTimer.getElapsedNanoSec());
+        }
+    }
+
+    // Second pass of adaptive antialiasing, run once the first pass is done and the edge pixels are
+    // found. Replaces each edge pixel with the average of _gridSize_ x _gridSize_ samples traced
+    // with _traceSettings_, one at a random position in each cell of a regular grid over the pixel.
+    // The samples are clamped before averaging, as they would be by rendering a larger image and
+    // downscaling it
+    void refine(const size_t threadId, const size_t threadCount, const size_t chunkSize, const int gridSize,
+        const TraceSettings& traceSettings) {
+        const std::vector<uint32_t>& edgePixels = antialias->getEdgePixels();
+        const SceneDimensions& dimens = scene->getSceneDimensions();
+        const float cellSize = 1.f / gridSize;
+        for (size_t i = (chunkSize * threadId); i < edgePixels.size(); i += (chunkSize * threadCount)) {
+            CRT_TRACE_SCOPE("refine chunk", "render", "first_edge_pixel", int64_t(i));
+            const size_t numChunkPixels = std::min(chunkSize, edgePixels.size() - i);
+            for (size_t c = 0; c < numChunkPixels; c++) {
+                const TileCostMeasure pixelCost(tileCosts);
+                const uint32_t pixel = edgePixels[i + c];
+                const int row = pixel / dimens.width;
+                const int col = pixel % dimens.width;
+                RNG jitter(pixel);
+                Colorf pixelColor;
+                for (int sampleRow = 0; sampleRow < gridSize; sampleRow++) {
+                    for (int sampleCol = 0; sampleCol < gridSize; sampleCol++) {
+                        const CRTRay cameraRay = camera.getRay(row, col, (sampleRow + jitter.uniformFloat()) * cellSize,
+                            (sampleCol + jitter.uniformFloat()) * cellSize);
+                        CRT_COUNT(CameraRays, 1);
+                        // seeded per pixel and sample so the image doesn't depend on the thread count
+                        const uint64_t sample = uint64_t(sampleRow) * gridSize + sampleCol;
+                        TraceContext context(traceSettings, ((sample + 1) << 32) | pixel);
+                        const Colorf sampleColor = rayTrace(cameraRay, scene, context);
+                        pixelColor += Colorf(clamp(0.f, 1.f, sampleColor.x), clamp(0.f, 1.f, sampleColor.y),
+                            clamp(0.f, 1.f, sampleColor.z));
+                    }
+                }
+                pixelColor *= cellSize * cellSize;
+                ppmImage.data[pixel].color = Colori(pixelColor.x * 255, pixelColor.y * 255, pixelColor.z * 255);
+                if (tileCosts) {
+                    tileCosts->addPixels(threadId, pixel, 1, pixelCost.getElapsedNanoSec(),
+                        pixelCost.getNumRays());
+                }
+            }
+        }
+    }
+
 private:
+    // Traces the camera ray through the center of _pixel_ and returns its color
+    Colorf tracePixel(const size_t pixel, TraceContext& context) const {
+        const int width = scene->getSceneDimensions().width;
+        const CRTRay cameraRay = camera.getRay(int(pixel / width), int(pixel % width));
+        CRT_COUNT(CameraRays, 1);
+        InfoIntersect infoIntersect;
+        const bool hit = scene->intersect(cameraRay, infoIntersect);
+        if (antialias) {
+            antialias->setPrimaryHit(pixel, hit ? infoIntersect.objectIdx : -1);
+        }
+        // shading pushes the secondary rays, so it must be done before the ray stack is traced
+        const Colorf color = shadeWeightedRay(WeightedRay{ cameraRay, Colorf(1.f) }, hit ? &infoIntersect : nullptr,
+            scene, context);
+        return color + traceRayStack(scene, context);
+    }
+
+    // Renders the image in blocks of _W_ x _H_ pixels whose camera rays are traced together as a
+    // RayPacket. Each thread takes about _chunkSize_ pixels worth of blocks at a time, and the
+    // secondary rays of every pixel are traced one by one after the packet
+    template <int W, int H>
+    void renderPackets(const size_t threadId, const size_t threadCount, const size_t chunkSize) {
+        constexpr int N = W * H;
+        const SceneDimensions& dimens = scene->getSceneDimensions();
+        const size_t blocksPerRow = (dimens.width + W - 1) / W;
+        const size_t numBlocks = blocksPerRow * ((dimens.height + H - 1) / H);
+        const size_t blocksPerChunk = std::max<size_t>(1, chunkSize / N);
+
+        const PacketKernels<N>& kernels = getPacketKernels<N>();
+        RayPacket<N> packet;
+        PacketHits<N> hits;
+        Colorf blockColors[N];
+        ShadowQueue shadowQueue;
+        for (size_t b = (blocksPerChunk * threadId); b < numBlocks; b += (blocksPerChunk * threadCount)) {
+            CRT_TRACE_SCOPE("render chunk", "render", "first_block", int64_t(b));
+            const size_t lastBlock = std::min(b + blocksPerChunk, numBlocks);
+            for (size_t block = b; block < lastBlock; block++) {
+                const TileCostMeasure blockCost(tileCosts);
+                const int blockRow = int(block / blocksPerRow) * H;
+                const int blockCol = int(block % blocksPerRow) * W;
+                packet.setCameraRays(camera, blockRow, blockCol, W);
+                for (int lane = 0; lane < N; lane++) {
+                    packet.active[lane] = blockRow + lane / W < dimens.height && blockCol + lane % W < dimens.width;
+                }
+
+                intersectPacket(scene, kernels, packet, hits);
+
+                for (int lane = 0; lane < N; lane++) {
+                    if (!packet.active[lane])
+                        continue;
+                    const size_t pixel = size_t(blockRow + lane / W) * dimens.width + blockCol + lane % W;
+                    // seeded per pixel so the image doesn't depend on the thread count or packets
+                    TraceContext context(settings.traceSettings, pixel);
+                    if (settings.batchShadowRays) {
+                        context.shadowQueue = &shadowQueue;
+                        context.pixelIdx = uint32_t(lane);
+                    }
+                    InfoIntersect infoIntersect;
+                    const bool hit = getPacketHitInfo(scene, packet, hits, lane, infoIntersect);
+                    CRT_COUNT(CameraRays, 1);
+                    CRT_COUNT(Hits, hit);
+                    if (antialias) {
+                        antialias->setPrimaryHit(pixel, hits.meshIdx[lane]);
+                    }
+                    blockColors[lane] = shadeWeightedRay(WeightedRay{ packet.getRay(lane), Colorf(1.f) },
+                        hit ? &infoIntersect : nullptr, scene, context);
+                    blockColors[lane] += traceRayStack(scene, context);
+                }
+
+                if (settings.batchShadowRays) {
+                    traceShadowQueue(shadowQueue, scene, blockColors);
+                }
+
+                for (int lane = 0; lane < N; lane++) {
+                    if (!packet.active[lane])
+                        continue;
+                    const Colorf& currPixelColor = blockColors[lane];
+                    const size_t pixel = size_t(blockRow + lane / W) * dimens.width + blockCol + lane % W;
+                    ppmImage.data[pixel].color = Colori(clamp(0.f, 1.f, currPixelColor.x) * 255,
+                        clamp(0.f, 1.f, currPixelColor.y) * 255,
+                        clamp(0.f, 1.f, currPixelColor.z) * 255);
+                }
+
+                if (tileCosts) {
+                    recordBlockCost<W, H>(threadId, blockRow, blockCol, blockCost.getElapsedNanoSec(),
+                        blockCost.getNumRays());
+                }
+            }
+        }
+    }
+
+    // Adds the cost of a packet block to its tile. COST_TILE_SIZE is a multiple of the block
+    // sides, so the whole block is in one tile, and the cost goes to its pixels inside the image
+    template <int W, int H>
+    void recordBlockCost(const size_t threadId, const int blockRow, const int blockCol, const int64_t nanoSec,
+        const uint64_t numRays) {
+        static_assert(COST_TILE_SIZE % W == 0 && COST_TILE_SIZE % H == 0, "Blocks must not span tiles");
+        const SceneDimensions& dimens = scene->getSceneDimensions();
+        const int numRows = std::min(H, dimens.height - blockRow);
+        const int numCols = std::min(W, dimens.width - blockCol);
+        for (int r = 0; r < numRows; r++) {
+            tileCosts->addPixels(threadId, size_t(blockRow + r) * dimens.width + blockCol, numCols,
+                nanoSec * (r + 1) / numRows - nanoSec * r / numRows,
+                numRays * (r + 1) / numRows - numRays * r / numRows);
+        }
+    }
+
     PPMImageI& ppmImage;  // Reference to the PPMImage to store the rendered image
     const Scene* scene;   // Pointer to the Scene object containing the scene data
+    const RenderSettings& settings;  // Settings that control the ray tracing
+    TileCostMap* tileCosts;  // Render cost of each tile, nullptr when not recorded
+    AntialiasMap* antialias;  // Camera ray hits of the pixels, nullptr when not antialiasing
+    const CRTCamera& camera;  // Camera the image is rendered from
 };
 
 #endif
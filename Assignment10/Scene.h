@@ -1,7 +1,9 @@
 #ifndef SCENE_H
 #define SCENE_H
 
+#include "LightTree.h"
 #include "Parser.h"
+#include "RenderStats.h"
 
 
 struct SceneParams {
@@ -10,6 +12,7 @@ struct SceneParams {
     std::vector<PointLight> lights;
     std::vector<Material> materials;
     SceneSettings settings;
+    MeshDedupStats dedupStats;
 };
 
 class Scene {
@@ -20,23 +23,27 @@ public:
         : camera(std::move(sceneParams.camera)),
         sceneObjects(std::move(sceneParams.objects)),
         sceneLights(std::move(sceneParams.lights)),
-        materials(std::move(sceneParams.materials)),
+        lightTree(sceneLights),
+        materialTable(sceneParams.materials),
         settings(std::move(sceneParams.settings)) {}
 
     bool intersect(const CRTRay& ray, InfoIntersect& info) const {
         bool hasIntersect = false;
         InfoIntersect closestPrim;
-        for (const auto& mesh : sceneObjects) {
-            if (mesh.intersect(ray, info)) {
+        for (size_t i = 0; i < sceneObjects.size(); i++) {
+            if (sceneObjects[i].intersect(ray, info)) {
                 if (info.t < closestPrim.t) {
                     closestPrim = info;
+                    closestPrim.objectIdx = int32_t(i);
                 }
                 hasIntersect = true;
             }
         }
 
-        if (hasIntersect)
+        if (hasIntersect) {
             info = closestPrim;
+            CRT_COUNT(Hits, 1);
+        }
 
         return hasIntersect;
     }
@@ -46,7 +53,7 @@ public:
         InfoIntersect closestPrim;
         for (const auto& mesh : sceneObjects) {
             if (mesh.intersectPrim(ray, closestPrim) &&
-                materials[closestPrim.materialIdx].type != MaterialType::Refractive) {
+                materialTable.getRef(closestPrim.materialIdx).type != MaterialType::Refractive) {
                 return true;
             }
         }
@@ -61,24 +68,39 @@ public:
 
     const std::vector<PointLight>& getLights() const { return sceneLights; }
 
+    const LightTree& getLightTree() const { return lightTree; }
+
     const std::vector<TriangleMesh>& getObjects() const { return sceneObjects; }
 
-    const std::vector<Material>& getMaterials() const { return materials; }
+    const MaterialTable& getMaterialTable() const { return materialTable; }
+
+    // Changes the camera and the image size, so a scene that stays loaded can render other views
+    // without being parsed and built again
+    void setView(const CRTCamera& _camera, const SceneDimensions& dimens) {
+        camera = _camera;
+        camera.setImageSize(dimens.width, dimens.height);
+        settings.sceneDimensions = dimens;
+    }
 
 private:
     CRTCamera camera;
     const std::vector<TriangleMesh> sceneObjects;
     const std::vector<PointLight> sceneLights;
-    const std::vector<Material> materials;
-    const SceneSettings settings;
+    const LightTree lightTree;
+    const MaterialTable materialTable;
+    SceneSettings settings;
 
 };
     inline static int32_t parseSceneParams(std::string_view inputFile, SceneParams& sceneParams) {
-        if (Parser::parseCameraParameters(inputFile, sceneParams.camera) != EXIT_SUCCESS) {
+        if (Parser::checkSceneFile(inputFile) != EXIT_SUCCESS) {
+            std::cerr << "Scene parser failed." << std::endl;
+            return EXIT_FAILURE;
+        }
+        else if (Parser::parseCameraParameters(inputFile, sceneParams.camera) != EXIT_SUCCESS) {
             std::cerr << "Scene parser failed." << std::endl;
             return EXIT_FAILURE;
         }
-        else if (Parser::parseSceneObjects(inputFile, sceneParams.objects) != EXIT_SUCCESS) {
+        else if (Parser::parseSceneObjects(inputFile, sceneParams.objects, sceneParams.dedupStats) != EXIT_SUCCESS) {
             std::cerr << "Scene parser failed." << std::endl;
             return EXIT_FAILURE;
         }
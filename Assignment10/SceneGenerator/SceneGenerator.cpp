@@ -0,0 +1,391 @@
+// Generates crtscene files of any size to measure how load time, memory and render time scale.
+// The same arguments and seed always produce the same file.
+//
+// Builds on Linux from this directory with plain g++ (or clang++ with the same arguments):
+//   g++ -std=c++20 -O2 -I.. -o scene_generator SceneGenerator.cpp
+//
+// Usage: scene_generator [--output=<file>] [--triangles=<count>] [--objects=<count>] [--lights=<count>]
+//     [--materials=<diffuse>,<reflective>,<refractive>,<constant>] [--distribution=uniform|clustered|grid]
+//     [--width=<pixels>] [--height=<pixels>] [--seed=<number>]
+// Counts accept K and M suffixes, e.g. --triangles=100M. Every object is a sphere built from the
+// 6 faces of a subdivided cube, so each one has 12 * n^2 triangles for the n closest to its share
+// of the triangles. The materials option gives the number of materials of each type, and the
+// objects pick them at random. The file is written object by object, so the size of the scene
+// is not limited by memory.
+#include <charconv>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "CRTVector.h"
+#include "Random.h"
+
+// Spatial layouts of the objects
+enum class Distribution { Uniform, Clustered, Grid };
+
+struct GeneratorOptions {
+    std::string outputFile = "generated.crtscene";
+    uint64_t numTriangles = 100'000;
+    uint64_t numObjects = 100;
+    uint64_t numLights = 4;
+    uint64_t numMaterials[4] = { 4, 1, 1, 0 };  // Diffuse, reflective, refractive and constant
+    Distribution distribution = Distribution::Uniform;
+    int width = 1920;
+    int height = 1080;
+    uint64_t seed = 1;
+};
+
+/// @brief Buffered writer of the JSON text, formatting numbers with std::to_chars
+class SceneWriter {
+public:
+    explicit SceneWriter(std::ofstream& _out) : out(_out) { buffer.reserve(BUFFER_SIZE + 64); }
+
+    ~SceneWriter() { flush(); }
+
+    SceneWriter& operator<<(const std::string_view text) {
+        buffer += text;
+        flushIfFull();
+        return *this;
+    }
+
+    SceneWriter& operator<<(const uint64_t value) {
+        char digits[24];
+        buffer.append(digits, std::to_chars(digits, digits + sizeof(digits), value).ptr);
+        flushIfFull();
+        return *this;
+    }
+
+    // Writes the shortest text that reads back as _value_. Whole numbers keep a decimal point,
+    // since the scene parser takes only numbers with one as floats
+    SceneWriter& operator<<(const float value) {
+        char digits[32];
+        char* end = std::to_chars(digits, digits + sizeof(digits), value).ptr;
+        buffer.append(digits, end);
+        if (std::string_view(digits, end - digits).find_first_of(".en") == std::string_view::npos) {
+            buffer += ".0";
+        }
+        flushIfFull();
+        return *this;
+    }
+
+    SceneWriter& operator<<(const CRTVectorf& v) { return *this << v.x << ", " << v.y << ", " << v.z; }
+
+    void flush() {
+        out.write(buffer.data(), std::streamsize(buffer.size()));
+        bytesWritten += buffer.size();
+        buffer.clear();
+    }
+
+    uint64_t getBytesWritten() const { return bytesWritten + buffer.size(); }
+
+private:
+    static constexpr size_t BUFFER_SIZE = 1 << 20;
+
+    void flushIfFull() {
+        if (buffer.size() >= BUFFER_SIZE) {
+            flush();
+        }
+    }
+
+    std::ofstream& out;
+    std::string buffer;
+    uint64_t bytesWritten = 0;
+};
+
+// Returns a random point in the box [-_extent_, _extent_]^3
+static CRTVectorf randomPoint(RNG& rng, const CRTVectorf& extent) {
+    return CRTVectorf((2.f * rng.uniformFloat() - 1.f) * extent.x, (2.f * rng.uniformFloat() - 1.f) * extent.y,
+        (2.f * rng.uniformFloat() - 1.f) * extent.z);
+}
+
+// Returns a normally distributed random number with the Box-Muller transform
+static float randomGaussian(RNG& rng) {
+    const float u1 = std::max(rng.uniformFloat(), 1e-7f);
+    const float u2 = rng.uniformFloat();
+    return std::sqrt(-2.f * std::log(u1)) * std::cos(2.f * PI * u2);
+}
+
+/// @brief Places the objects in the scene by the chosen distribution
+class ObjectPlacer {
+public:
+    ObjectPlacer(const GeneratorOptions& options, RNG& rng)
+        : distribution(options.distribution), numObjects(options.numObjects),
+        gridSide(uint64_t(std::ceil(std::cbrt(double(options.numObjects))))),
+        extent(CRTVectorf(1.f, 0.5f, 1.f) * (OBJECT_SPACING * 0.5f * gridSide)) {
+        if (distribution == Distribution::Clustered) {
+            const uint64_t numClusters = std::max<uint64_t>(1, gridSide);
+            for (uint64_t i = 0; i < numClusters; i++) {
+                clusterCenters.push_back(randomPoint(rng, extent * 0.75f));
+            }
+        }
+    }
+
+    // Returns the center of object _objectIdx_
+    CRTVectorf getCenter(const uint64_t objectIdx, RNG& rng) const {
+        switch (distribution) {
+        case Distribution::Grid: {
+            const float x = float(objectIdx % gridSide);
+            const float y = float(objectIdx / gridSide % gridSide);
+            const float z = float(objectIdx / (gridSide * gridSide));
+            const float half = 0.5f * (gridSide - 1);
+            return CRTVectorf(x - half, 0.5f * (y - half), z - half) * OBJECT_SPACING;
+        }
+        case Distribution::Clustered: {
+            const CRTVectorf& clusterCenter = clusterCenters[rng.uniformUInt32() % clusterCenters.size()];
+            const float spread = 0.15f * extent.x;
+            return clusterCenter + CRTVectorf(randomGaussian(rng), 0.5f * randomGaussian(rng), randomGaussian(rng)) *
+                spread;
+        }
+        default:
+            return randomPoint(rng, extent);
+        }
+    }
+
+    const CRTVectorf& getExtent() const { return extent; }
+
+    static constexpr float OBJECT_SPACING = 3.f;  // Distance between neighbouring objects of the grid
+    static constexpr float MAX_OBJECT_RADIUS = 1.2f;
+
+private:
+    const Distribution distribution;
+    const uint64_t numObjects;
+    const uint64_t gridSide;   // Objects along each side of the grid
+    const CRTVectorf extent;   // Half size of the box holding the objects
+    std::vector<CRTVectorf> clusterCenters;
+};
+
+static void writeSettings(SceneWriter& writer, const GeneratorOptions& options, const CRTVectorf& extent) {
+    // the camera looks down at the scene center from 30 degrees above the front, far enough for the
+    // camera's 90 degree vertical field of view to take in the whole scene
+    const float aspectRatio = float(options.width) / options.height;
+    const float radius = ObjectPlacer::MAX_OBJECT_RADIUS;
+    const float distance = extent.z + radius + std::max((extent.x + radius) / aspectRatio, extent.y + radius);
+    const float tilt = PI / 6.f;
+    const float cameraHeight = distance * std::sin(tilt);
+    const float cameraDist = distance * std::cos(tilt);
+    const float cosTilt = std::cos(tilt), sinTilt = std::sin(tilt);
+
+    writer << "{\n\t\"settings\": {\n\t\t\"background_color\": [" << CRTVectorf(0.1f, 0.1f, 0.15f)
+        << "],\n\t\t\"image_settings\": {\n\t\t\t\"width\": " << uint64_t(options.width) << ",\n\t\t\t\"height\": "
+        << uint64_t(options.height) << ",\n\t\t\t\"bucket_size\": 24\n\t\t}\n\t},\n"
+        << "\t\"camera\": {\n\t\t\"matrix\": [" << CRTVectorf(1.f, 0.f, 0.f) << ", "
+        << CRTVectorf(0.f, cosTilt, -sinTilt) << ", " << CRTVectorf(0.f, sinTilt, cosTilt)
+        << "],\n\t\t\"position\": [" << CRTVectorf(0.f, cameraHeight, cameraDist) << "]\n\t},\n";
+}
+
+static void writeLights(SceneWriter& writer, const GeneratorOptions& options, const CRTVectorf& extent,
+    RNG& rng) {
+    // keeps the total light power reaching the scene about the same for any size and number of lights
+    const float sceneSize = std::max(extent.x, 5.f);
+    const uint64_t intensity =
+        std::max<uint64_t>(1, uint64_t(8000.f * sceneSize * sceneSize / 100.f / options.numLights));
+    writer << "\t\"lights\": [";
+    for (uint64_t i = 0; i < options.numLights; i++) {
+        const CRTVectorf position = randomPoint(rng, extent) + CRTVectorf(0.f, 2.f * extent.y + 2.f, 0.f);
+        writer << (i ? ",\n" : "\n") << "\t\t{ \"intensity\": " << intensity << ", \"position\": [" << position
+            << "] }";
+    }
+    writer << "\n\t],\n";
+}
+
+// Writes the materials grouped by type, in the order of GeneratorOptions::numMaterials
+static void writeMaterials(SceneWriter& writer, const GeneratorOptions& options, RNG& rng) {
+    static const char* typeNames[4] = { "diffuse", "reflective", "refractive", "constant" };
+    writer << "\t\"materials\": [";
+    bool first = true;
+    for (int type = 0; type < 4; type++) {
+        for (uint64_t i = 0; i < options.numMaterials[type]; i++) {
+            writer << (first ? "\n" : ",\n") << "\t\t{ \"type\": \"" << typeNames[type] << "\", ";
+            first = false;
+            if (type == 2) {
+                writer << "\"ior\": " << 1.3f + 0.3f * rng.uniformFloat();
+            }
+            else {
+                const CRTVectorf albedo(0.2f + 0.8f * rng.uniformFloat(), 0.2f + 0.8f * rng.uniformFloat(),
+                    0.2f + 0.8f * rng.uniformFloat());
+                writer << "\"albedo\": [" << albedo << "]";
+            }
+            writer << ", \"smooth_shading\": true }";
+        }
+    }
+    writer << "\n\t],\n";
+}
+
+// Writes a sphere of the given center and radii made of the 6 faces of a cube, each divided into
+// _n_ x _n_ quads, with the triangles wound so their normals point outwards
+static void writeSphere(SceneWriter& writer, const CRTVectorf& center, const CRTVectorf& radii,
+    const uint64_t n, const uint64_t materialIdx) {
+    writer << "\t\t{\n\t\t\t\"material_index\": " << materialIdx << ",\n\t\t\t\"vertices\": [";
+    for (int face = 0; face < 6; face++) {
+        const int axis = face % 3;
+        const float side = face < 3 ? 1.f : -1.f;
+        for (uint64_t i = 0; i <= n; i++) {
+            for (uint64_t j = 0; j <= n; j++) {
+                CRTVectorf p;
+                p[axis] = side;
+                p[(axis + 1) % 3] = -1.f + 2.f * i / n;
+                p[(axis + 2) % 3] = -1.f + 2.f * j / n;
+                const float invLength = 1.f / p.length();
+                const CRTVectorf v(center.x + p.x * invLength * radii.x, center.y + p.y * invLength * radii.y,
+                    center.z + p.z * invLength * radii.z);
+                writer << ((face | i | j) ? ",\n\t\t\t\t" : "\n\t\t\t\t") << v;
+            }
+        }
+    }
+
+    writer << "\n\t\t\t],\n\t\t\t\"triangles\": [";
+    const uint64_t faceVerts = (n + 1) * (n + 1);
+    for (uint64_t face = 0; face < 6; face++) {
+        const bool flip = face >= 3;
+        for (uint64_t i = 0; i < n; i++) {
+            for (uint64_t j = 0; j < n; j++) {
+                const uint64_t v00 = face * faceVerts + i * (n + 1) + j;
+                const uint64_t v10 = v00 + n + 1;
+                const uint64_t v01 = v00 + 1;
+                const uint64_t v11 = v10 + 1;
+                writer << ((face | i | j) ? ",\n\t\t\t\t" : "\n\t\t\t\t");
+                if (flip) {
+                    writer << v00 << ", " << v01 << ", " << v10 << ", " << v11 << ", " << v10 << ", " << v01;
+                }
+                else {
+                    writer << v00 << ", " << v10 << ", " << v01 << ", " << v11 << ", " << v01 << ", " << v10;
+                }
+            }
+        }
+    }
+    writer << "\n\t\t\t]\n\t\t}";
+}
+
+// Parses a count with an optional K or M suffix. Returns false if _text_ is not such a count
+static bool parseCount(std::string_view text, uint64_t& count) {
+    uint64_t scale = 1;
+    if (!text.empty() && (text.back() == 'K' || text.back() == 'k')) {
+        scale = 1'000;
+        text.remove_suffix(1);
+    }
+    else if (!text.empty() && (text.back() == 'M' || text.back() == 'm')) {
+        scale = 1'000'000;
+        text.remove_suffix(1);
+    }
+    const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), count);
+    count *= scale;
+    return error == std::errc() && end == text.data() + text.size();
+}
+
+static int32_t parseOptions(int argc, char** argv, GeneratorOptions& options) {
+    for (int i = 1; i < argc; i++) {
+        const std::string_view arg = argv[i];
+        const size_t equals = arg.find('=');
+        const std::string_view name = arg.substr(0, equals);
+        const std::string_view value = equals == std::string_view::npos ? "" : arg.substr(equals + 1);
+        uint64_t count = 0;
+        bool valid = true;
+        if (name == "--output") {
+            options.outputFile = value;
+            valid = !value.empty();
+        }
+        else if (name == "--triangles") {
+            valid = parseCount(value, options.numTriangles);
+        }
+        else if (name == "--objects") {
+            valid = parseCount(value, options.numObjects) && options.numObjects > 0;
+        }
+        else if (name == "--lights") {
+            valid = parseCount(value, options.numLights) && options.numLights > 0;
+        }
+        else if (name == "--seed") {
+            valid = parseCount(value, options.seed);
+        }
+        else if (name == "--width" || name == "--height") {
+            valid = parseCount(value, count) && count > 0 && count <= 16384;
+            (name == "--width" ? options.width : options.height) = int(count);
+        }
+        else if (name == "--materials") {
+            std::string_view rest = value;
+            uint64_t total = 0;
+            for (int type = 0; type < 4 && valid; type++) {
+                const size_t comma = rest.find(',');
+                valid = parseCount(rest.substr(0, comma), options.numMaterials[type]) &&
+                    (type == 3) == (comma == std::string_view::npos);
+                total += options.numMaterials[type];
+                rest = comma == std::string_view::npos ? "" : rest.substr(comma + 1);
+            }
+            valid = valid && total > 0;
+        }
+        else if (name == "--distribution") {
+            valid = value == "uniform" || value == "clustered" || value == "grid";
+            options.distribution = value == "grid" ? Distribution::Grid :
+                value == "clustered" ? Distribution::Clustered : Distribution::Uniform;
+        }
+        else {
+            valid = false;
+        }
+
+        if (!valid) {
+            std::cerr << "Invalid argument " << arg << ". See the usage at the top of SceneGenerator.cpp" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char** argv) {
+    GeneratorOptions options;
+    if (parseOptions(argc, argv, options) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+
+    std::ofstream out(options.outputFile, std::ios::out | std::ios::binary);
+    if (!out.good()) {
+        std::cerr << "Failed to open " << options.outputFile << " file." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // each part of the scene draws from its own generator, so changing one option doesn't
+    // change the rest of the scene
+    RNG placementRng(options.seed), lightRng(options.seed + 1), materialRng(options.seed + 2);
+    const ObjectPlacer placer(options, placementRng);
+    uint64_t numMaterials = 0;
+    for (const uint64_t count : options.numMaterials) {
+        numMaterials += count;
+    }
+
+    SceneWriter writer(out);
+    writeSettings(writer, options, placer.getExtent());
+    writeLights(writer, options, placer.getExtent(), lightRng);
+    writeMaterials(writer, options, materialRng);
+
+    writer << "\t\"objects\": [\n";
+    uint64_t totalTriangles = 0, totalVertices = 0;
+    for (uint64_t i = 0; i < options.numObjects; i++) {
+        // splits the triangles evenly, with the remainder going to the first objects
+        const uint64_t objectTriangles =
+            options.numTriangles / options.numObjects + (i < options.numTriangles % options.numObjects);
+        const uint64_t n = std::max<uint64_t>(1, uint64_t(std::llround(std::sqrt(objectTriangles / 12.0))));
+        const CRTVectorf center = placer.getCenter(i, placementRng);
+        const float radius = ObjectPlacer::MAX_OBJECT_RADIUS * (0.5f + 0.5f * placementRng.uniformFloat());
+        const CRTVectorf radii = CRTVectorf(0.7f + 0.3f * placementRng.uniformFloat(),
+            0.7f + 0.3f * placementRng.uniformFloat(), 0.7f + 0.3f * placementRng.uniformFloat()) * radius;
+        const uint64_t materialIdx = placementRng.uniformUInt32() % numMaterials;
+
+        writeSphere(writer, center, radii, n, materialIdx);
+        writer << (i + 1 < options.numObjects ? ",\n" : "\n");
+        totalTriangles += 12 * n * n;
+        totalVertices += 6 * (n + 1) * (n + 1);
+    }
+    writer << "\t]\n}\n";
+    writer.flush();
+
+    if (!out.good()) {
+        std::cerr << "Failed to write " << options.outputFile << " file." << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "Generated " << options.outputFile << ": " << options.numObjects << " objects, " << totalTriangles
+        << " triangles, " << totalVertices << " vertices, " << options.numLights << " lights, " << numMaterials
+        << " materials, " << writer.getBytesWritten() / (1024.0 * 1024.0) << "MB\n";
+    return EXIT_SUCCESS;
+}
@@ -9,6 +9,8 @@
 #include <queue>
 #include <thread>
 #include "Constants.h"
+#include "HardwareCounters.h"
+#include "TraceRecorder.h"
 
 // This header file guard ensures that the code is included only once
 // to prevent duplicate definitions when multiple files include this header.
@@ -31,7 +33,7 @@ public:
         Assert(!running && "Can't start ThreadPool if it's already running");
         running = true;
         for (size_t i = 0; i < workers.size(); ++i) {
-            workers[i] = std::thread(&ThreadPool::workerBase, this);
+            workers[i] = std::thread(&ThreadPool::workerBase, this, i);
         }
     }
     // The `start` function initializes and starts the ThreadPool by creating and starting worker threads.
@@ -49,6 +51,7 @@ public:
     // and clearing the workers vector.
 
     void completeTasks() {
+        CRT_TRACE_SCOPE("wait for tasks", "pool");
         for (;;) {
             if (numTasks == 0) {
                 break;
@@ -74,10 +77,15 @@ public:
     // increments the number of tasks, and notifies one worker thread to wake up and execute the task.
 
 private:
-    void workerBase() {
+    void workerBase(const size_t workerIdx) {
+        if (TraceRecorder::get().isEnabled()) {
+            TraceRecorder::get().setThreadName("worker " + std::to_string(workerIdx));
+        }
+        openThreadHwCounters();
         for (;;) {
             std::function<void()> task;
             {
+                CRT_TRACE_SCOPE("queue wait", "pool");
                 std::unique_lock<std::mutex> lock(tasksMutex);
                 workersCv.wait(lock, [this] { return !tasksQueue.empty() || !running; });
                 if (!running)
@@ -85,13 +93,18 @@ private:
                 task = std::move(tasksQueue.front());
                 tasksQueue.pop();
             }
-            task();
+            {
+                CRT_TRACE_SCOPE("task", "pool");
+                task();
+            }
             --numTasks;
         }
     }
     // The `workerBase` function represents the main loop of each worker thread.
     // It waits until there is a task in the tasksQueue or the ThreadPool is stopped.
     // It retrieves a task from the tasksQueue, executes it, and decrements the number of tasks.
+    // The waits for a task and the task runs are recorded by the TraceRecorder when it is enabled,
+    // and the hardware events of the thread are counted when the hardware counters are enabled.
 
 private:
     std::vector<std::thread> workers{};
@@ -0,0 +1,175 @@
+#ifndef TILECOSTS_H
+#define TILECOSTS_H
+
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <optional>
+#include <ostream>
+#include <vector>
+#include "MathUtil.h"
+#include "PPMImage.h"
+#include "RenderStats.h"
+#include "Timer.h"
+
+// Render time and rays of a render thread
+struct alignas(64) ThreadCost {
+    int64_t nanoSec = 0;
+    uint64_t numPixels = 0;
+    uint64_t numRays = 0;
+};
+
+// Returns the number of rays the calling thread has traced so far. The rays are counted by the
+// render counters, so this is always 0 when CRT_ENABLE_STATS is 0
+inline static uint64_t getThreadRayCount() {
+#if CRT_ENABLE_STATS
+    return getThreadStatCounters().getNumRays();
+#else
+    return 0;
+#endif
+}
+
+class TileCostMap;
+
+// Render time and rays of a piece of work on the calling thread. The clock and the ray count are
+// only read when _tileCosts_ is set, so the render path pays nothing for it when costs aren't recorded
+class TileCostMeasure {
+public:
+    explicit TileCostMeasure(const TileCostMap* tileCosts) {
+        if (tileCosts) {
+            timer.emplace();
+            startRays = getThreadRayCount();
+        }
+    }
+
+    int64_t getElapsedNanoSec() const { return timer ? timer->getElapsedNanoSec() : 0; }
+
+    uint64_t getNumRays() const { return timer ? getThreadRayCount() - startRays : 0; }
+
+private:
+    std::optional<Timer> timer;  // Unset when the costs aren't recorded
+    uint64_t startRays = 0;
+};
+
+/// @brief Render time and ray count of each COST_TILE_SIZE x COST_TILE_SIZE tile of the image
+/// and of each render thread, recorded while rendering to find the expensive regions of a scene
+/// and to check how evenly the work is split between the threads.
+class TileCostMap {
+public:
+    TileCostMap() = delete;
+
+    TileCostMap(const int _width, const int _height, const size_t numThreads)
+        : width(_width), height(_height), tilesPerRow((_width + COST_TILE_SIZE - 1) / COST_TILE_SIZE),
+        tilesPerColumn((_height + COST_TILE_SIZE - 1) / COST_TILE_SIZE),
+        tileNanoSec(tilesPerRow * tilesPerColumn), tileRays(tilesPerRow * tilesPerColumn),
+        threadCosts(numThreads) {}
+
+    // Adds the cost of rendering the _numPixels_ pixels from image pixel _firstPixel_ on thread
+    // _threadId_. A run spanning several tiles is split between them by its number of pixels in each,
+    // rounded so that the shares add up to the totals
+    void addPixels(const size_t threadId, const size_t firstPixel, const size_t numPixels, const int64_t nanoSec,
+        const uint64_t numRays) {
+        threadCosts[threadId].numPixels += numPixels;
+        addCost(threadId, firstPixel, numPixels, nanoSec, numRays);
+    }
+
+    // Adds the cost of more work on pixels addPixels already counted, such as the batched shadow
+    // rays of a chunk, without counting the pixels again
+    void addCost(const size_t threadId, const size_t firstPixel, const size_t numPixels, const int64_t nanoSec,
+        const uint64_t numRays) {
+        ThreadCost& threadCost = threadCosts[threadId];
+        threadCost.nanoSec += nanoSec;
+        threadCost.numRays += numRays;
+
+        const size_t lastPixel = firstPixel + numPixels;
+        for (size_t p = firstPixel; p < lastPixel;) {
+            const int row = int(p / width);
+            const int col = int(p % width);
+            const int tileEndCol = std::min(width, (col / COST_TILE_SIZE + 1) * COST_TILE_SIZE);
+            const size_t numTilePixels = std::min(lastPixel - p, size_t(tileEndCol - col));
+            const size_t tile = size_t(row / COST_TILE_SIZE) * tilesPerRow + col / COST_TILE_SIZE;
+            const size_t begin = p - firstPixel;
+            const size_t end = begin + numTilePixels;
+            tileNanoSec[tile].fetch_add(int64_t((nanoSec * end) / numPixels - (nanoSec * begin) / numPixels),
+                std::memory_order_relaxed);
+            tileRays[tile].fetch_add((numRays * end) / numPixels - (numRays * begin) / numPixels,
+                std::memory_order_relaxed);
+            p += numTilePixels;
+        }
+    }
+
+    // Writes an image of the size of the render where each tile is colored by its render time,
+    // from blue for the cheapest to red for the most expensive one
+    void writeHeatmap(std::ostream& out) const {
+        int64_t maxNanoSec = 1;
+        for (const std::atomic<int64_t>& nanoSec : tileNanoSec) {
+            maxNanoSec = std::max(maxNanoSec, nanoSec.load(std::memory_order_relaxed));
+        }
+
+        PPMImageI heatmap(width, height);
+        for (int row = 0; row < height; row++) {
+            for (int col = 0; col < width; col++) {
+                const size_t tile = size_t(row / COST_TILE_SIZE) * tilesPerRow + col / COST_TILE_SIZE;
+                const float cost = float(tileNanoSec[tile].load(std::memory_order_relaxed)) / maxNanoSec;
+                heatmap.data[size_t(row) * width + col].color = getHeatColor(cost);
+            }
+        }
+        serializePPMImage(out, heatmap);
+    }
+
+    // Writes one line per tile with its pixel rectangle, render time and number of rays
+    void writeCsv(std::ostream& out) const {
+        out << "tile_col,tile_row,x,y,width,height,time_us,rays\n";
+        for (int tileRow = 0; tileRow < tilesPerColumn; tileRow++) {
+            for (int tileCol = 0; tileCol < tilesPerRow; tileCol++) {
+                const size_t tile = size_t(tileRow) * tilesPerRow + tileCol;
+                const int x = tileCol * COST_TILE_SIZE;
+                const int y = tileRow * COST_TILE_SIZE;
+                out << tileCol << "," << tileRow << "," << x << "," << y << ","
+                    << std::min(COST_TILE_SIZE, width - x) << "," << std::min(COST_TILE_SIZE, height - y) << ","
+                    << Timer::toMicroSec<double>(double(tileNanoSec[tile].load(std::memory_order_relaxed))) << ","
+                    << tileRays[tile].load(std::memory_order_relaxed) << "\n";
+            }
+        }
+    }
+
+    // Prints the work done by each render thread and how far the slowest one is from the average
+    void printBalance(std::ostream& out) const {
+        out << "Render thread balance:\n";
+        int64_t maxNanoSec = 0, totalNanoSec = 0;
+        for (size_t i = 0; i < threadCosts.size(); i++) {
+            const ThreadCost& threadCost = threadCosts[i];
+            out << "  thread " << i << ": " << Timer::toMilliSec<float>(threadCost.nanoSec) << "ms, "
+                << threadCost.numPixels << " pixels, " << threadCost.numRays << " rays\n";
+            maxNanoSec = std::max(maxNanoSec, threadCost.nanoSec);
+            totalNanoSec += threadCost.nanoSec;
+        }
+        if (totalNanoSec > 0) {
+            out << "  slowest thread / average: "
+                << double(maxNanoSec) * threadCosts.size() / totalNanoSec << "\n";
+        }
+    }
+
+private:
+    // Maps _cost_ in [0, 1] to a blue, cyan, green, yellow, red color ramp
+    static Colori getHeatColor(const float cost) {
+        static const Colorf ramp[] = { Colorf(0.f, 0.f, 1.f), Colorf(0.f, 1.f, 1.f), Colorf(0.f, 1.f, 0.f),
+            Colorf(1.f, 1.f, 0.f), Colorf(1.f, 0.f, 0.f) };
+        constexpr int numSegments = int(std::size(ramp)) - 1;
+        const float x = clamp(0.f, 1.f, cost) * numSegments;
+        const int segment = std::min(int(x), numSegments - 1);
+        const float f = x - segment;
+        const Colorf color = ramp[segment] * (1.f - f) + ramp[segment + 1] * f;
+        return Colori(int(color.x * MAX_COLOR_COMP), int(color.y * MAX_COLOR_COMP), int(color.z * MAX_COLOR_COMP));
+    }
+
+    const int width;
+    const int height;
+    const int tilesPerRow;
+    const int tilesPerColumn;
+    std::vector<std::atomic<int64_t>> tileNanoSec;  // Render time of each tile, row by row
+    std::vector<std::atomic<uint64_t>> tileRays;    // Rays traced for each tile
+    std::vector<ThreadCost> threadCosts;  // Indexed by the thread id given to the renderers
+};
+
+#endif
@@ -0,0 +1,164 @@
+#ifndef TRACERECORDER_H
+#define TRACERECORDER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// The trace scopes are compiled in unless CRT_ENABLE_TRACE is defined as 0. They record nothing
+// until TraceRecorder::start is called
+#ifndef CRT_ENABLE_TRACE
+#define CRT_ENABLE_TRACE 1
+#endif
+
+// A timed scope of a thread. The names must be string literals, since only the pointers are kept
+struct TraceEvent {
+    const char* name;
+    const char* category;
+    const char* argName;    // Name of _arg_, nullptr if the event has no argument
+    int64_t arg;
+    int64_t beginNanoSec;   // Since the recorder was started
+    int64_t durationNanoSec;
+};
+
+// Events recorded by one thread. Only the owning thread appends to it, so recording needs no lock
+struct TraceBuffer {
+    uint32_t threadId = 0;
+    std::string threadName;
+    std::vector<TraceEvent> events;
+};
+
+/// @brief Records the timed scopes of all threads and writes them as a Chrome trace event JSON
+/// file, which chrome://tracing and Perfetto show as one timeline per thread.
+class TraceRecorder {
+public:
+    static TraceRecorder& get() {
+        static TraceRecorder recorder;
+        return recorder;
+    }
+
+    TraceRecorder(const TraceRecorder&) = delete;
+    TraceRecorder& operator=(const TraceRecorder&) = delete;
+
+    // Starts recording, with the times of the events measured from now
+    void start() {
+        startTime = clock::now();
+        enabled.store(true, std::memory_order_release);
+    }
+
+    void stop() { enabled.store(false, std::memory_order_release); }
+
+    bool isEnabled() const { return enabled.load(std::memory_order_relaxed); }
+
+    int64_t getNanoSec() const {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - startTime).count();
+    }
+
+    // Returns the buffer of the calling thread, registered on the first call from that thread.
+    // The buffers are owned by the recorder, so they outlive the threads that fill them
+    TraceBuffer& getThreadBuffer() {
+        thread_local TraceBuffer* buffer = registerThread();
+        return *buffer;
+    }
+
+    // Names the timeline of the calling thread
+    void setThreadName(std::string name) { getThreadBuffer().threadName = std::move(name); }
+
+    // Writes the events of all threads. Must be called only while no thread is recording
+    void writeJson(std::ostream& out) {
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        bool first = true;
+        for (const std::unique_ptr<TraceBuffer>& buffer : buffers) {
+            out << (first ? "\n" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+                << buffer->threadId << ",\"args\":{\"name\":\"" << buffer->threadName << "\"}}";
+            first = false;
+            for (const TraceEvent& event : buffer->events) {
+                out << ",\n{\"name\":\"" << event.name << "\",\"cat\":\"" << event.category
+                    << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->threadId
+                    << ",\"ts\":" << MicroSec{ event.beginNanoSec }
+                    << ",\"dur\":" << MicroSec{ event.durationNanoSec };
+                if (event.argName) {
+                    out << ",\"args\":{\"" << event.argName << "\":" << event.arg << "}";
+                }
+                out << "}";
+            }
+        }
+        out << "\n]}\n";
+    }
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    // Nanoseconds printed as microseconds with 3 decimals, the unit of the trace event timestamps
+    struct MicroSec {
+        int64_t nanoSec;
+
+        friend std::ostream& operator<<(std::ostream& out, const MicroSec& time) {
+            const int64_t fraction = time.nanoSec % 1000;
+            return out << time.nanoSec / 1000 << "." << char('0' + fraction / 100) << char('0' + fraction / 10 % 10)
+                << char('0' + fraction % 10);
+        }
+    };
+
+    TraceRecorder() = default;
+
+    TraceBuffer* registerThread() {
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        buffers.push_back(std::make_unique<TraceBuffer>());
+        TraceBuffer* buffer = buffers.back().get();
+        buffer->threadId = uint32_t(buffers.size());
+        buffer->threadName = "thread " + std::to_string(buffer->threadId);
+        buffer->events.reserve(4096);
+        return buffer;
+    }
+
+    std::atomic_bool enabled = false;
+    clock::time_point startTime = clock::now();
+    std::mutex buffersMutex;  // Guards the list of buffers, not their events
+    std::vector<std::unique_ptr<TraceBuffer>> buffers;
+};
+
+// Records the lifetime of the scope it is declared in as an event, if the recorder is enabled
+class TraceScope {
+public:
+    TraceScope(const char* _name, const char* _category, const char* _argName = nullptr, const int64_t _arg = 0)
+        : name(_name), category(_category), argName(_argName), arg(_arg),
+        beginNanoSec(TraceRecorder::get().isEnabled() ? TraceRecorder::get().getNanoSec() : -1) {}
+
+    ~TraceScope() {
+        if (beginNanoSec < 0)
+            return;
+        TraceRecorder& recorder = TraceRecorder::get();
+        const int64_t endNanoSec = recorder.getNanoSec();
+        recorder.getThreadBuffer().events.push_back(
+            TraceEvent{ name, category, argName, arg, beginNanoSec, endNanoSec - beginNanoSec });
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* name;
+    const char* category;
+    const char* argName;
+    int64_t arg;
+    int64_t beginNanoSec;  // -1 if the recorder was disabled when the scope began
+};
+
+#define CRT_TRACE_JOIN_NAME(a, b) a##b
+#define CRT_TRACE_SCOPE_NAME(line) CRT_TRACE_JOIN_NAME(traceScope, line)
+
+#if CRT_ENABLE_TRACE
+// Traces the enclosing scope: CRT_TRACE_SCOPE(name, category[, argName, arg])
+#define CRT_TRACE_SCOPE(...) const TraceScope CRT_TRACE_SCOPE_NAME(__LINE__)(__VA_ARGS__)
+#else
+#define CRT_TRACE_SCOPE(...) ((void)0)
+#endif
+
+#endif
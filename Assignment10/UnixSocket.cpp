@@ -0,0 +1,125 @@
+#include "UnixSocket.h"
+#include <iostream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+// Broken connections are reported by write instead of killing the process with SIGPIPE
+#if defined(MSG_NOSIGNAL)
+static constexpr int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+static constexpr int SEND_FLAGS = 0;
+#endif
+
+SocketConnection::~SocketConnection() { close(fd); }
+
+bool SocketConnection::readLine(std::string& line) {
+    size_t lineEnd;
+    while ((lineEnd = buffer.find('\n')) == std::string::npos) {
+        char chunk[4096];
+        const ssize_t numRead = recv(fd, chunk, sizeof(chunk), 0);
+        if (numRead < 0 && errno == EINTR) {
+            continue;
+        }
+        if (numRead <= 0) {
+            return false;
+        }
+        buffer.append(chunk, size_t(numRead));
+    }
+    line.assign(buffer, 0, lineEnd);
+    if (!line.empty() && line.back() == '\r') {
+        line.pop_back();
+    }
+    buffer.erase(0, lineEnd + 1);
+    return true;
+}
+
+bool SocketConnection::write(std::string_view data) {
+    while (!data.empty()) {
+        const ssize_t numWritten = send(fd, data.data(), data.size(), SEND_FLAGS);
+        if (numWritten < 0 && errno == EINTR) {
+            continue;
+        }
+        if (numWritten <= 0) {
+            return false;
+        }
+        data.remove_prefix(size_t(numWritten));
+    }
+    return true;
+}
+
+UnixSocketServer::~UnixSocketServer() {
+    if (fd >= 0) {
+        close(fd);
+        unlink(socketPath.c_str());
+    }
+}
+
+bool UnixSocketServer::listen(const std::string& path) {
+    sockaddr_un address{};
+    if (path.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Socket path " << path << " is longer than " << sizeof(address.sun_path) - 1 << " characters"
+            << std::endl;
+        return false;
+    }
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    // a socket file left by a daemon that didn't exit cleanly would make bind fail, but any other
+    // file at the path is kept, it is most likely a mistyped path
+    struct stat status;
+    if (lstat(path.c_str(), &status) == 0) {
+        if (!S_ISSOCK(status.st_mode)) {
+            std::cerr << "Failed to listen on " << path << ": the file exists and isn't a socket" << std::endl;
+            return false;
+        }
+        unlink(path.c_str());
+    }
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        std::cerr << "Failed to create a socket: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+#if defined(SO_NOSIGPIPE)
+    const int noSigPipe = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &noSigPipe, sizeof(noSigPipe));
+#endif
+    if (bind(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || ::listen(fd, 8) != 0) {
+        std::cerr << "Failed to listen on " << path << ": " << std::strerror(errno) << std::endl;
+        close(fd);
+        fd = -1;
+        return false;
+    }
+    socketPath = path;
+    return true;
+}
+
+int UnixSocketServer::accept() {
+    int connectionFd;
+    do {
+        connectionFd = ::accept(fd, nullptr, nullptr);
+    } while (connectionFd < 0 && errno == EINTR);
+    return connectionFd;
+}
+#else
+SocketConnection::~SocketConnection() {}
+
+bool SocketConnection::readLine(std::string&) { return false; }
+
+bool SocketConnection::write(std::string_view) { return false; }
+
+UnixSocketServer::~UnixSocketServer() {}
+
+bool UnixSocketServer::listen(const std::string&) {
+    std::cerr << "Unix domain sockets are only supported on POSIX systems" << std::endl;
+    return false;
+}
+
+int UnixSocketServer::accept() { return -1; }
+#endif
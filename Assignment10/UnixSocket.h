@@ -0,0 +1,50 @@
+#ifndef UNIXSOCKET_H
+#define UNIXSOCKET_H
+
+#include <string>
+#include <string_view>
+
+// Connection accepted on a UnixSocketServer. Closed when destroyed
+class SocketConnection {
+public:
+    explicit SocketConnection(const int _fd) : fd(_fd) {}
+    ~SocketConnection();
+
+    SocketConnection(const SocketConnection&) = delete;
+    SocketConnection& operator=(const SocketConnection&) = delete;
+
+    // Reads the next line, without its line break. Returns false once the peer closed the
+    // connection or it failed
+    bool readLine(std::string& line);
+
+    // Writes all of _data_. Returns false if the connection failed
+    bool write(std::string_view data);
+
+private:
+    const int fd;
+    std::string buffer;  // Bytes read past the last line returned
+};
+
+/// @brief Unix domain socket listening for the connections of local clients. Only available on
+/// POSIX systems; elsewhere listen fails.
+class UnixSocketServer {
+public:
+    UnixSocketServer() = default;
+    ~UnixSocketServer();
+
+    UnixSocketServer(const UnixSocketServer&) = delete;
+    UnixSocketServer& operator=(const UnixSocketServer&) = delete;
+
+    // Creates the socket file _path_, replacing a stale one, and listens on it. Returns false and
+    // prints the reason if it can't
+    bool listen(const std::string& path);
+
+    // Waits for the next client. Returns the descriptor of its connection, -1 if accepting failed
+    int accept();
+
+private:
+    int fd = -1;
+    std::string socketPath;
+};
+
+#endif
@@ -0,0 +1,340 @@
+#ifndef WAVEFRONTRENDERER_H
+#define WAVEFRONTRENDERER_H
+
+#include <array>
+#include <string>
+#include "Renderer.h"
+
+static constexpr size_t WAVEFRONT_BATCH_SIZE = 4096;  // Number of pixels processed by a wavefront at once
+
+// Stages a wavefront of rays passes through
+enum class WavefrontStage : int { CameraRays, ClosestHit, MaterialSort, Shade, ShadowRays, Count };
+
+// The names are string literals, so they can be used as trace event names
+inline static const char* getWavefrontStageName(const WavefrontStage stage) {
+    static const char* stageNames[int(WavefrontStage::Count)] = { "camera rays", "closest hit", "material sort",
+        "shade", "shadow rays" };
+    return stageNames[int(stage)];
+}
+
+// Time spent and items processed in each wavefront stage
+struct WavefrontStageTimes {
+    std::array<int64_t, int(WavefrontStage::Count)> nanoSec{};
+    std::array<size_t, int(WavefrontStage::Count)> numItems{};
+
+    void add(const WavefrontStage stage, const int64_t stageNanoSec, const size_t stageItems) {
+        nanoSec[int(stage)] += stageNanoSec;
+        numItems[int(stage)] += stageItems;
+    }
+
+    void add(const WavefrontStageTimes& other) {
+        for (int i = 0; i < int(WavefrontStage::Count); i++) {
+            nanoSec[i] += other.nanoSec[i];
+            numItems[i] += other.numItems[i];
+        }
+    }
+
+    void print(std::ostream& out) const {
+        out << "Wavefront stages (summed over threads):\n";
+        for (int i = 0; i < int(WavefrontStage::Count); i++) {
+            out << "  " << getWavefrontStageName(WavefrontStage(i)) << ": " << Timer::toMilliSec<float>(nanoSec[i])
+                << "ms, " << numItems[i] << " items\n";
+        }
+    }
+};
+
+// Queue of rays stored as structure of arrays, so each stage streams only the fields it uses
+struct RayQueue {
+    std::vector<float> originX, originY, originZ;
+    std::vector<float> dirX, dirY, dirZ;
+    std::vector<float> weightR, weightG, weightB;
+    std::vector<int> depth;
+    std::vector<uint32_t> pixelIdx;  // Index of the pixel in the batch the ray contributes to
+
+    size_t size() const { return pixelIdx.size(); }
+
+    void resize(const size_t count) {
+        for (std::vector<float>* field : { &originX, &originY, &originZ, &dirX, &dirY, &dirZ,
+            &weightR, &weightG, &weightB }) {
+            field->resize(count);
+        }
+        depth.resize(count);
+        pixelIdx.resize(count);
+    }
+
+    void clear() { resize(0); }
+
+    void push(const CRTRay& ray, const Colorf& weight, const uint32_t pixel) {
+        originX.push_back(ray.origin.x), originY.push_back(ray.origin.y), originZ.push_back(ray.origin.z);
+        dirX.push_back(ray.dir.x), dirY.push_back(ray.dir.y), dirZ.push_back(ray.dir.z);
+        weightR.push_back(weight.x), weightG.push_back(weight.y), weightB.push_back(weight.z);
+        depth.push_back(ray.depth);
+        pixelIdx.push_back(pixel);
+    }
+
+    CRTRay getRay(const size_t idx) const {
+        CRTRay ray(Pointf(originX[idx], originY[idx], originZ[idx]),
+            CRTVectorf(dirX[idx], dirY[idx], dirZ[idx]));
+        ray.depth = depth[idx];
+        return ray;
+    }
+
+    Colorf getWeight(const size_t idx) const { return Colorf(weightR[idx], weightG[idx], weightB[idx]); }
+
+    // Stores the rays from _first_ on in the lanes of _packet_. The lanes past the last ray of the
+    // queue repeat it and are inactive
+    template <int N>
+    void getPacket(const size_t first, RayPacket<N>& packet) const {
+        for (int lane = 0; lane < N; lane++) {
+            const size_t idx = std::min(first + lane, size() - 1);
+            packet.originX[lane] = originX[idx], packet.originY[lane] = originY[idx];
+            packet.originZ[lane] = originZ[idx];
+            packet.dirX[lane] = dirX[idx], packet.dirY[lane] = dirY[idx], packet.dirZ[lane] = dirZ[idx];
+            packet.invDirX[lane] = 1 / dirX[idx], packet.invDirY[lane] = 1 / dirY[idx];
+            packet.invDirZ[lane] = 1 / dirZ[idx];
+            packet.tMax[lane] = MAX_FLOAT;
+            packet.active[lane] = first + lane < size();
+        }
+    }
+};
+
+// Closest hits found for the rays of a queue
+struct HitQueue {
+    std::vector<InfoIntersect> infos;
+    std::vector<uint32_t> rayIdx;     // Index of the ray in the ray queue
+    std::vector<uint32_t> sortKeys;   // Material type, table slot and direction octant of the hit ray
+
+    void clear() {
+        infos.clear();
+        rayIdx.clear();
+        sortKeys.clear();
+    }
+};
+
+// Returns the octant of direction _dir_ as 3 sign bits
+inline static uint32_t getDirectionOctant(const float dirX, const float dirY, const float dirZ) {
+    return uint32_t(dirX < 0.f) | (uint32_t(dirY < 0.f) << 1) | (uint32_t(dirZ < 0.f) << 2);
+}
+
+/// @brief Renderer that traces a batch of pixels stage by stage instead of pixel by pixel.
+/// Camera ray generation, closest hit, material sort & shade and shadow rays each run over the
+/// whole batch before the next stage starts, and the secondary rays spawned by the shading form
+/// the next wavefront of the batch.
+class WavefrontRenderer {
+public:
+    WavefrontRenderer() = delete;
+
+    // Constructor that takes the image, the scene, the render settings, the per-thread stage times,
+    // optionally the map to record the cost of each tile in and the map to record the camera ray
+    // hits of the pixels in, which is required for antialiasing
+    WavefrontRenderer(PPMImageI& _ppmImage, const Scene* _scene, const RenderSettings& _settings,
+        std::vector<WavefrontStageTimes>& _threadStageTimes, TileCostMap* _tileCosts = nullptr,
+        AntialiasMap* _antialias = nullptr)
+        : ppmImage(_ppmImage), scene(_scene), settings(_settings), threadStageTimes(_threadStageTimes),
+        tileCosts(_tileCosts), antialias(_antialias) {}
+
+    // Renders the batches of _batchSize_ pixels assigned to thread _threadId_
+    void render(const size_t threadId, const size_t threadCount, const size_t batchSize) {
+        WavefrontStageTimes& stageTimes = threadStageTimes[threadId];
+        // the generator of the context takes the state of the pixel of each hit, see shadeHit
+        TraceContext context(settings.traceSettings, 0);
+        ShadowQueue shadowQueue;
+        context.shadowQueue = &shadowQueue;
+
+        RayQueue rays, nextRays;
+        HitQueue hits;
+        std::vector<std::pair<uint32_t, uint32_t>> shadeOrder;
+        std::vector<Colorf> batchColors(batchSize);
+        std::vector<RNG> pixelRngs;
+
+        for (size_t i = (batchSize * threadId); i < ppmImage.data.size(); i += (batchSize * threadCount)) {
+            CRT_TRACE_SCOPE("render batch", "render", "first_pixel", int64_t(i));
+            const size_t numBatchPixels = std::min(batchSize, ppmImage.data.size() - i);
+            std::fill(batchColors.begin(), batchColors.begin() + numBatchPixels, Colorf(0.f));
+            // seeded per pixel as in Renderer, so the image doesn't depend on the thread count
+            pixelRngs.clear();
+            for (size_t c = 0; c < numBatchPixels; c++) {
+                pixelRngs.emplace_back(i + c);
+            }
+            // the stages interleave the pixels of the batch, so its cost is spread evenly over them
+            const TileCostMeasure batchCost(tileCosts);
+
+            {
+                Timer timer;
+                CRT_TRACE_SCOPE(getWavefrontStageName(WavefrontStage::CameraRays), "wavefront");
+                generateCameraRays(i, numBatchPixels, rays);
+                stageTimes.add(WavefrontStage::CameraRays, timer.getElapsedNanoSec(), numBatchPixels);
+            }
+
+            while (rays.size() > 0) {
+                {
+                    Timer timer;
+                    CRT_TRACE_SCOPE(getWavefrontStageName(WavefrontStage::ClosestHit), "wavefront");
+                    findClosestHits(i, rays, hits, batchColors);
+                    stageTimes.add(WavefrontStage::ClosestHit, timer.getElapsedNanoSec(), rays.size());
+                }
+
+                {
+                    Timer timer;
+                    CRT_TRACE_SCOPE(getWavefrontStageName(WavefrontStage::MaterialSort), "wavefront");
+                    shadeOrder.resize(hits.infos.size());
+                    for (uint32_t h = 0; h < hits.infos.size(); h++) {
+                        shadeOrder[h] = { hits.sortKeys[h], h };
+                    }
+                    std::sort(shadeOrder.begin(), shadeOrder.end());
+                    stageTimes.add(WavefrontStage::MaterialSort, timer.getElapsedNanoSec(), shadeOrder.size());
+                }
+
+                {
+                    Timer timer;
+                    CRT_TRACE_SCOPE(getWavefrontStageName(WavefrontStage::Shade), "wavefront");
+                    nextRays.clear();
+                    for (const auto& [key, hitIdx] : shadeOrder) {
+                        shadeHit(rays, hits, hitIdx, context, pixelRngs, nextRays, batchColors);
+                    }
+                    stageTimes.add(WavefrontStage::Shade, timer.getElapsedNanoSec(), shadeOrder.size());
+                }
+
+                {
+                    Timer timer;
+                    CRT_TRACE_SCOPE(getWavefrontStageName(WavefrontStage::ShadowRays), "wavefront");
+                    const size_t numShadowRays = shadowQueue.size();
+                    traceShadowQueue(shadowQueue, scene, batchColors.data());
+                    stageTimes.add(WavefrontStage::ShadowRays, timer.getElapsedNanoSec(), numShadowRays);
+                }
+
+                std::swap(rays, nextRays);
+            }
+
+            for (size_t c = 0; c < numBatchPixels; c++) {
+                const Colorf& currPixelColor = batchColors[c];
+                ppmImage.data[i + c].color = Colori(clamp(0.f, 1.f, currPixelColor.x) * 255,
+                    clamp(0.f, 1.f, currPixelColor.y) * 255,
+                    clamp(0.f, 1.f, currPixelColor.z) * 255);
+            }
+
+            if (tileCosts) {
+                tileCosts->addPixels(threadId, i, numBatchPixels, batchCost.getElapsedNanoSec(),
+                    batchCost.getNumRays());
+            }
+        }
+    }
+
+private:
+    // Fills _rays_ with the camera rays of _numPixels_ pixels starting from pixel _firstPixel_
+    void generateCameraRays(const size_t firstPixel, const size_t numPixels, RayQueue& rays) const {
+        const int width = scene->getSceneDimensions().width;
+        const CRTCamera& camera = scene->getCamera();
+        rays.resize(numPixels);
+
+        // the batch may span several image rows, so generate the directions row segment by row segment
+        for (size_t c = 0; c < numPixels;) {
+            const uint32_t row = uint32_t((firstPixel + c) / width);
+            const uint32_t col = uint32_t((firstPixel + c) % width);
+            const uint32_t numCols = uint32_t(std::min<size_t>(numPixels - c, width - col));
+            camera.getTileRayDirs(row, col, 1, numCols, &rays.dirX[c], &rays.dirY[c], &rays.dirZ[c]);
+            c += numCols;
+        }
+
+        CRT_COUNT(CameraRays, numPixels);
+        const Pointf origin = camera.getLookFrom();
+        for (size_t c = 0; c < numPixels; c++) {
+            rays.originX[c] = origin.x, rays.originY[c] = origin.y, rays.originZ[c] = origin.z;
+            rays.weightR[c] = rays.weightG[c] = rays.weightB[c] = 1.f;
+            rays.depth[c] = 0;
+            rays.pixelIdx[c] = uint32_t(c);
+        }
+    }
+
+    // Finds the closest hit of each ray of the batch starting at pixel _firstPixel_. The rays are
+    // tested in groups of the packet size of the settings with the packet kernels, or one by one
+    // without packets. Rays that miss add the background color to their pixel
+    void findClosestHits(const size_t firstPixel, const RayQueue& rays, HitQueue& hits,
+        std::vector<Colorf>& batchColors) const {
+        hits.clear();
+        if (settings.packetSize == 4) {
+            findPacketHits<4>(firstPixel, rays, hits, batchColors);
+            return;
+        }
+        if (settings.packetSize == 8) {
+            findPacketHits<8>(firstPixel, rays, hits, batchColors);
+            return;
+        }
+
+        for (size_t r = 0; r < rays.size(); r++) {
+            InfoIntersect infoIntersect;
+            const bool hit = scene->intersect(rays.getRay(r), infoIntersect);
+            addHit(firstPixel, rays, r, hit, infoIntersect, hits, batchColors);
+        }
+    }
+
+    // Finds the closest hits of the rays of the queue _N_ at a time with the packet kernels of the
+    // selected CPU path, see findClosestHits
+    template <int N>
+    void findPacketHits(const size_t firstPixel, const RayQueue& rays, HitQueue& hits,
+        std::vector<Colorf>& batchColors) const {
+        const PacketKernels<N>& kernels = getPacketKernels<N>();
+        RayPacket<N> packet;
+        PacketHits<N> packetHits;
+        for (size_t first = 0; first < rays.size(); first += N) {
+            rays.getPacket(first, packet);
+            intersectPacket(scene, kernels, packet, packetHits);
+            const int numLanes = int(std::min<size_t>(N, rays.size() - first));
+            for (int lane = 0; lane < numLanes; lane++) {
+                InfoIntersect infoIntersect;
+                const bool hit = getPacketHitInfo(scene, packet, packetHits, lane, infoIntersect);
+                CRT_COUNT(Hits, hit);
+                addHit(firstPixel, rays, first + lane, hit, infoIntersect, hits, batchColors);
+            }
+        }
+    }
+
+    // Queues the hit of ray _r_ of the batch starting at pixel _firstPixel_ to be shaded, or adds
+    // the background color to its pixel if it missed
+    void addHit(const size_t firstPixel, const RayQueue& rays, const size_t r, const bool hit,
+        const InfoIntersect& infoIntersect, HitQueue& hits, std::vector<Colorf>& batchColors) const {
+        if (antialias && rays.depth[r] == 0) {
+            antialias->setPrimaryHit(firstPixel + rays.pixelIdx[r], hit ? infoIntersect.objectIdx : -1);
+        }
+        if (hit) {
+            const MaterialRef& materialRef = scene->getMaterialTable().getRef(infoIntersect.materialIdx);
+            hits.sortKeys.push_back((uint32_t(materialRef.type) << 29) | (materialRef.slot << 3) |
+                getDirectionOctant(rays.dirX[r], rays.dirY[r], rays.dirZ[r]));
+            hits.infos.push_back(infoIntersect);
+            hits.rayIdx.push_back(uint32_t(r));
+        }
+        else {
+            batchColors[rays.pixelIdx[r]] += rays.getWeight(r) * scene->getBackground();
+        }
+    }
+
+    // Shades a hit with the random numbers of its pixel in _pixelRngs_. Its shadow rays go to the
+    // context shadow queue and its secondary rays to _nextRays_
+    void shadeHit(const RayQueue& rays, const HitQueue& hits, const uint32_t hitIdx, TraceContext& context,
+        std::vector<RNG>& pixelRngs, RayQueue& nextRays, std::vector<Colorf>& batchColors) const {
+        const uint32_t rayIdx = hits.rayIdx[hitIdx];
+        const InfoIntersect& infoIntersect = hits.infos[hitIdx];
+        const Colorf weight = rays.getWeight(rayIdx);
+        const uint32_t pixelIdx = rays.pixelIdx[rayIdx];
+
+        context.pixelIdx = pixelIdx;
+        // the ray stack draws from the context generator too, so the pixel state is swapped into it
+        context.rng = pixelRngs[pixelIdx];
+        batchColors[pixelIdx] += weight * shade(rays.getRay(rayIdx), scene, infoIntersect, weight, context);
+
+        while (!context.rayStack.empty()) {
+            const WeightedRay secondary = context.rayStack.pop();
+            nextRays.push(secondary.ray, secondary.weight, pixelIdx);
+        }
+        pixelRngs[pixelIdx] = context.rng;
+    }
+
+    PPMImageI& ppmImage;  // Reference to the PPMImage to store the rendered image
+    const Scene* scene;   // Pointer to the Scene object containing the scene data
+    const RenderSettings& settings;  // Settings that control the ray tracing
+    std::vector<WavefrontStageTimes>& threadStageTimes;  // Stage times of each rendering thread
+    TileCostMap* tileCosts;  // Render cost of each tile, nullptr when not recorded
+    AntialiasMap* antialias;  // Camera ray hits of the pixels, nullptr when not antialiasing
+};
+
+#endif